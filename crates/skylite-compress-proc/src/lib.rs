@@ -1,7 +1,13 @@
+use std::collections::hash_map::DefaultHasher;
 use std::env;
+use std::fs;
+use std::hash::Hasher;
+use std::path::PathBuf;
+use std::sync::{atomic::{self, AtomicUsize}, Mutex};
+use std::thread;
 
 use proc_macro2::{Group, Ident, Literal, Punct, Spacing, Span, TokenStream, TokenTree};
-use skylite_compress::{compress, CompressionMethods, CompressionReport};
+use skylite_compress::{compress, CompressionMethods, CompressionReport, MethodStats};
 
 extern crate proc_macro;
 
@@ -26,33 +32,103 @@ fn get_report_mode() -> ReportMode {
 }
 
 fn calc_percent_reduction(initial_size: usize, new_size: usize) -> f32 {
-    100.0 - (initial_size - new_size) as f32 / initial_size as f32 * 100.0
+    // Computed in floating point because a method may also grow the data,
+    // in which case an integer difference would underflow.
+    new_size as f32 / initial_size as f32 * 100.0
+}
+
+fn method_name(method: &CompressionMethods) -> &'static str {
+    match method {
+        CompressionMethods::Raw => "Raw data",
+        CompressionMethods::LZ77 { .. } => "Lempel-Ziv 77",
+        CompressionMethods::RC { .. } => "Range Coding"
+    }
+}
+
+fn format_stats(stats: &MethodStats) -> String {
+    match stats {
+        MethodStats::Lz77 { matches: 0, .. } => "no matches".to_owned(),
+        MethodStats::Lz77 { matches, match_bits } =>
+            format!("{} matches, avg length {} bits", matches, match_bits / matches),
+        MethodStats::Rc { renormalizations } => format!("{} renormalizations", renormalizations),
+        MethodStats::None => String::new()
+    }
 }
 
 fn print_compression_report(data_name: &str, initial_size: usize, reports: &[CompressionReport]) {
     match get_report_mode() {
         ReportMode::Normal => {
-            let final_size = reports.last().unwrap().compressed_size;
-            println!("{}: from {} to {} (reduction of {:.2}%)", data_name, initial_size, final_size, calc_percent_reduction(initial_size, final_size));
+            // Sizes within the reports are in bits.
+            let final_size = (reports.last().unwrap().compressed_size + 7) / 8;
+            println!("{}: from {} to {} bytes (reduction to {:.2}%)", data_name, initial_size, final_size, calc_percent_reduction(initial_size, final_size));
         },
         ReportMode::Full => {
-            let prev_size = initial_size;
             println!("{}:", data_name);
             for report in reports {
-                let method_name = match report.method {
-                    CompressionMethods::Raw => "Raw data",
-                    CompressionMethods::LZ77 => "Lempel-Ziv 77",
-                    CompressionMethods::RC => "Range Coding"
-                };
                 if report.skipped {
-                    println!("\t{}: (skipped)", method_name);
+                    println!("\t{}: (skipped after {:.1?})", method_name(&report.method), report.time);
                 } else {
-                    println!("\t{}: from {} to {} (reduction of {:.2}%)", method_name, prev_size, report.compressed_size, calc_percent_reduction(prev_size, report.compressed_size));
+                    println!(
+                        "\t{}: from {} to {} bits (reduction to {:.2}%) in {:.1?}; {}",
+                        method_name(&report.method),
+                        report.input_size,
+                        report.compressed_size,
+                        calc_percent_reduction(report.input_size, report.compressed_size),
+                        report.time,
+                        format_stats(&report.stats)
+                    );
                 }
             }
         },
         ReportMode::None => {}
     }
+
+    write_machine_report(data_name, initial_size, reports);
+}
+
+/// Appends a JSON line for this asset to the file named by
+/// `SKYLITE_COMPRESSION_REPORT_FILE`, so CI can trend per-asset build
+/// cost over time. Formatted by hand; the structure is flat enough that
+/// a serialization dependency is not worth it.
+fn write_machine_report(data_name: &str, initial_size: usize, reports: &[CompressionReport]) {
+    let path = match env::var_os("SKYLITE_COMPRESSION_REPORT_FILE") {
+        Some(path) => path,
+        None => return
+    };
+
+    let methods: Vec<String> = reports.iter()
+        .map(|report| {
+            let stats = match report.stats {
+                MethodStats::Lz77 { matches, match_bits } =>
+                    format!(",\"matches\":{},\"match_bits\":{}", matches, match_bits),
+                MethodStats::Rc { renormalizations } =>
+                    format!(",\"renormalizations\":{}", renormalizations),
+                MethodStats::None => String::new()
+            };
+            format!(
+                "{{\"method\":\"{}\",\"skipped\":{},\"input_bits\":{},\"output_bits\":{},\"time_us\":{}{}}}",
+                method_name(&report.method),
+                report.skipped,
+                report.input_size,
+                report.compressed_size,
+                report.time.as_micros(),
+                stats
+            )
+        })
+        .collect();
+
+    let line = format!(
+        "{{\"name\":{:?},\"input_bytes\":{},\"output_bytes\":{},\"methods\":[{}]}}\n",
+        data_name,
+        initial_size,
+        (reports.last().map(|r| r.compressed_size).unwrap_or(initial_size * 8) + 7) / 8,
+        methods.join(",")
+    );
+    let _ = fs::OpenOptions::new()
+        .create(true)
+        .append(true)
+        .open(path)
+        .and_then(|mut file| std::io::Write::write_all(&mut file, line.as_bytes()));
 }
 
 #[derive(Debug)]
@@ -79,18 +155,99 @@ impl Into<TokenStream> for ProcError {
     }
 }
 
-fn generate_tokens(data_name: &str, data: &[u8], methods: &[CompressionMethods]) -> TokenStream {
+/// Location of the cached output for the given input, or `None` if
+/// caching is disabled. The file name is a hash over the input bytes and
+/// the full method list including parameters.
+fn cache_path(data: &[u8], methods: &[CompressionMethods]) -> Option<PathBuf> {
+    let dir = env::var_os("SKYLITE_CACHE_DIR")?;
+    let mut hasher = DefaultHasher::new();
+    hasher.write(data);
+    for method in methods {
+        match method {
+            CompressionMethods::Raw => hasher.write_u8(0),
+            CompressionMethods::LZ77 { window_exp, lazy } => {
+                hasher.write_u8(1);
+                hasher.write_u8(*window_exp);
+                hasher.write_u8(*lazy as u8);
+            },
+            CompressionMethods::RC { adaptive } => {
+                hasher.write_u8(2);
+                hasher.write_u8(*adaptive as u8);
+            }
+        }
+    }
+    Some(PathBuf::from(dir).join(format!("skylite-{:016x}.bin", hasher.finish())))
+}
+
+/// Runs `compress`, unless `SKYLITE_CACHE_DIR` is set and already holds
+/// the output for this input. Reports are `None` when the result came
+/// from the cache.
+fn compress_with_cache(data: &[u8], methods: &[CompressionMethods]) -> (Vec<u8>, Option<Vec<CompressionReport>>) {
+    let path = match cache_path(data, methods) {
+        Some(path) => path,
+        None => {
+            let (compressed_data, reports) = compress(data, methods);
+            return (compressed_data, Some(reports));
+        }
+    };
+
+    if let Ok(cached) = fs::read(&path) {
+        return (cached, None);
+    }
+
     let (compressed_data, reports) = compress(data, methods);
-    print_compression_report(data_name, data.len(), &reports);
-    TokenTree::Group(Group::new(
-        proc_macro2::Delimiter::Bracket,
-        TokenStream::from_iter(
-            compressed_data.iter().flat_map(|v| [
-                TokenTree::Literal(Literal::u8_suffixed(*v)),
-                TokenTree::Punct(Punct::new(',', Spacing::Alone))
-            ])
-        )
-    )).into()
+
+    // A failure to populate the cache only costs time on the next build,
+    // so it is not reported as an error.
+    if let Some(parent) = path.parent() {
+        let _ = fs::create_dir_all(parent);
+    }
+    let _ = fs::write(&path, &compressed_data);
+
+    (compressed_data, Some(reports))
+}
+
+/// Prints the report for one compression result, whether it ran or was
+/// served from the cache.
+fn report_result(data_name: &str, input_len: usize, compressed: &[u8], reports: &Option<Vec<CompressionReport>>) {
+    match reports {
+        Some(reports) => print_compression_report(data_name, input_len, reports),
+        None => match get_report_mode() {
+            ReportMode::None => {},
+            _ => println!("{}: from {} to {} bytes (cached)", data_name, input_len, compressed.len())
+        }
+    }
+}
+
+/// Emits compressed data as a single dereferenced byte-string literal
+/// (`*b"..."`), which evaluates to a `[u8; N]` like the old bracketed
+/// list but is one token for rustc to parse instead of one per byte.
+/// When the data came from a file, the expression also embeds an
+/// `include_bytes!` of that file so that changing it triggers a rebuild.
+fn data_expr_tokens(compressed_data: &[u8], source_path: Option<&std::path::Path>) -> TokenStream {
+    let data_tokens = TokenStream::from_iter([
+        TokenTree::Punct(Punct::new('*', Spacing::Alone)),
+        TokenTree::Literal(Literal::byte_string(compressed_data))
+    ]);
+
+    match source_path {
+        None => data_tokens,
+        Some(path) => {
+            let tracker: TokenStream = format!("const _: &[u8] = include_bytes!({:?});", path.display().to_string())
+                .parse()
+                .unwrap();
+            TokenTree::Group(Group::new(
+                proc_macro2::Delimiter::Brace,
+                TokenStream::from_iter(tracker.into_iter().chain(data_tokens))
+            )).into()
+        }
+    }
+}
+
+fn generate_tokens(data_name: &str, data: &[u8], methods: &[CompressionMethods], source_path: Option<&std::path::Path>) -> TokenStream {
+    let (compressed_data, reports) = compress_with_cache(data, methods);
+    report_result(data_name, data.len(), &compressed_data, &reports);
+    data_expr_tokens(&compressed_data, source_path)
 }
 
 /// Iterator over a `TokenStream` that ensures that the `TokenStream`
@@ -153,8 +310,12 @@ fn literals_to_methods(iter: DelimitedListIterator) -> Result<Vec<CompressionMet
             Err(ProcError::Syntax("Expected compression methods identifier".to_owned()))
         })
         .map(|l| match l?.to_string().as_str() {
-            "lz77" => Ok(CompressionMethods::LZ77),
-            "rc" => Ok(CompressionMethods::RC),
+            "lz77" => Ok(CompressionMethods::LZ77 { window_exp: skylite_compress::LZ77_WINDOW_SMALL, lazy: false }),
+            "lz77_lazy" => Ok(CompressionMethods::LZ77 { window_exp: skylite_compress::LZ77_WINDOW_SMALL, lazy: true }),
+            "lz77_64k" => Ok(CompressionMethods::LZ77 { window_exp: skylite_compress::LZ77_WINDOW_LARGE, lazy: false }),
+            "lz77_64k_lazy" => Ok(CompressionMethods::LZ77 { window_exp: skylite_compress::LZ77_WINDOW_LARGE, lazy: true }),
+            "rc" => Ok(CompressionMethods::RC { adaptive: true }),
+            "rc_static" => Ok(CompressionMethods::RC { adaptive: false }),
             s @ _ => Err(ProcError::Data(format!("Unknown compression method {}", s)))
         })
         .collect();
@@ -170,8 +331,62 @@ fn literals_to_methods(iter: DelimitedListIterator) -> Result<Vec<CompressionMet
     Ok(out)
 }
 
+/// Handles the file-based form `compressed!(path = "<path>", [<methods>], <name>)`.
+/// The path is resolved relative to `CARGO_MANIFEST_DIR`.
+fn compressed_from_path(tokens: Vec<TokenTree>) -> TokenStream {
+    match tokens.get(1) {
+        Some(TokenTree::Punct(p)) if p.as_char() == '=' => {},
+        _ => return ProcError::Syntax("Expected '=' after 'path'".to_owned()).into()
+    }
+    let raw = match tokens.get(2) {
+        Some(TokenTree::Literal(l)) => l.to_string(),
+        _ => return ProcError::Syntax("Expected string literal for path".to_owned()).into()
+    };
+    if !(raw.len() >= 2 && raw.starts_with('"') && raw.ends_with('"')) {
+        return ProcError::Syntax("Path must be a plain string literal".to_owned()).into();
+    }
+    let relative = &raw[1..raw.len() - 1];
+
+    let manifest_dir = env::var("CARGO_MANIFEST_DIR").unwrap_or_else(|_| ".".to_owned());
+    let path = PathBuf::from(manifest_dir).join(relative);
+    let data = match fs::read(&path) {
+        Ok(d) => d,
+        Err(err) => return ProcError::Data(format!("Could not read {}: {}", path.display(), err)).into()
+    };
+
+    match tokens.get(3) {
+        Some(TokenTree::Punct(p)) if p.as_char() == ',' => {},
+        _ => return ProcError::Syntax("Expected ','".to_owned()).into()
+    }
+    let mut params: DelimitedListIterator = TokenStream::from_iter(tokens.into_iter().skip(4)).into();
+
+    let method_iter: DelimitedListIterator = match params.next() {
+        Some(Ok(TokenTree::Group(g))) => g.stream().into(),
+        Some(Err(err)) => return err.into(),
+        _ => return ProcError::Syntax("Expected list of compression methods".to_owned()).into()
+    };
+    let methods = match literals_to_methods(method_iter) {
+        Ok(m) => m,
+        Err(err) => return err.into()
+    };
+
+    let data_name = match params.next() {
+        Some(Ok(TokenTree::Literal(token))) => token.to_string(),
+        None => relative.to_owned(),
+        Some(Err(err)) => return err.into(),
+        _ => return ProcError::Syntax("Data name must be a string lteral".to_owned()).into()
+    };
+
+    generate_tokens(&data_name, &data, &methods, Some(&path))
+}
+
 fn compressed2(stream: TokenStream) -> TokenStream {
-    let mut params: DelimitedListIterator = stream.into();
+    let tokens: Vec<TokenTree> = stream.into_iter().collect();
+    if matches!(tokens.first(), Some(TokenTree::Ident(i)) if i.to_string() == "path") {
+        return compressed_from_path(tokens);
+    }
+
+    let mut params: DelimitedListIterator = TokenStream::from_iter(tokens).into();
 
     let data_iter: DelimitedListIterator = match params.next() {
         Some(Ok(TokenTree::Group(g))) => g.stream().into(),
@@ -202,18 +417,171 @@ fn compressed2(stream: TokenStream) -> TokenStream {
         _ => return ProcError::Syntax("Data name must be a string lteral".to_owned()).into()
     };
 
-    generate_tokens(&data_name, &data, &methods)
+    generate_tokens(&data_name, &data, &methods, None)
+}
+
+struct BatchEntry {
+    name: String,
+    data: Vec<u8>,
+    methods: Vec<CompressionMethods>,
+    source_path: Option<PathBuf>
+}
+
+/// Parses one `(<name>, <data or path>, [<methods>])` batch entry.
+fn parse_batch_entry(stream: TokenStream) -> Result<BatchEntry, ProcError> {
+    let tokens: Vec<TokenTree> = stream.into_iter().collect();
+
+    let name = match tokens.first() {
+        Some(TokenTree::Ident(ident)) => ident.to_string(),
+        _ => return Err(ProcError::Syntax("Expected constant name".to_owned()))
+    };
+    match tokens.get(1) {
+        Some(TokenTree::Punct(p)) if p.as_char() == ',' => {},
+        _ => return Err(ProcError::Syntax("Expected ','".to_owned()))
+    }
+
+    let (data, source_path, methods_at) = match tokens.get(2) {
+        Some(TokenTree::Group(g)) => (literals_to_data(g.stream().into())?, None, 3),
+        Some(TokenTree::Ident(ident)) if ident.to_string() == "path" => {
+            match tokens.get(3) {
+                Some(TokenTree::Punct(p)) if p.as_char() == '=' => {},
+                _ => return Err(ProcError::Syntax("Expected '=' after 'path'".to_owned()))
+            }
+            let raw = match tokens.get(4) {
+                Some(TokenTree::Literal(l)) => l.to_string(),
+                _ => return Err(ProcError::Syntax("Expected string literal for path".to_owned()))
+            };
+            if !(raw.len() >= 2 && raw.starts_with('"') && raw.ends_with('"')) {
+                return Err(ProcError::Syntax("Path must be a plain string literal".to_owned()));
+            }
+            let manifest_dir = env::var("CARGO_MANIFEST_DIR").unwrap_or_else(|_| ".".to_owned());
+            let path = PathBuf::from(manifest_dir).join(&raw[1..raw.len() - 1]);
+            let data = fs::read(&path)
+                .map_err(|err| ProcError::Data(format!("Could not read {}: {}", path.display(), err)))?;
+            (data, Some(path), 5)
+        },
+        _ => return Err(ProcError::Syntax("Expected data or path".to_owned()))
+    };
+
+    match tokens.get(methods_at) {
+        Some(TokenTree::Punct(p)) if p.as_char() == ',' => {},
+        _ => return Err(ProcError::Syntax("Expected ','".to_owned()))
+    }
+    let methods = match tokens.get(methods_at + 1) {
+        Some(TokenTree::Group(g)) => literals_to_methods(g.stream().into())?,
+        _ => return Err(ProcError::Syntax("Expected list of compression methods".to_owned()))
+    };
+    if tokens.len() > methods_at + 2 {
+        return Err(ProcError::Syntax("Unexpected tokens after methods list".to_owned()));
+    }
+
+    Ok(BatchEntry {
+        name,
+        data,
+        methods,
+        source_path
+    })
+}
+
+fn compressed_batch2(stream: TokenStream) -> TokenStream {
+    let params: DelimitedListIterator = stream.into();
+    let mut entries = Vec::new();
+    for param in params {
+        let group = match param {
+            Ok(TokenTree::Group(g)) => g,
+            Ok(_) => return ProcError::Syntax("Expected parenthesized batch entry".to_owned()).into(),
+            Err(err) => return err.into()
+        };
+        match parse_batch_entry(group.stream()) {
+            Ok(entry) => entries.push(entry),
+            Err(err) => return err.into()
+        }
+    }
+
+    // All entries are compressed within this single expansion, spread
+    // across the available cores; rustc's sequential macro expansion
+    // only ever sees the one invocation.
+    let results: Mutex<Vec<Option<(Vec<u8>, Option<Vec<CompressionReport>>)>>> =
+        Mutex::new(vec![None; entries.len()]);
+    let next_entry = AtomicUsize::new(0);
+    let num_workers = usize::min(
+        entries.len(),
+        thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    );
+    thread::scope(|s| {
+        for _ in 0..num_workers {
+            s.spawn(|| loop {
+                let idx = next_entry.fetch_add(1, atomic::Ordering::Relaxed);
+                if idx >= entries.len() {
+                    break;
+                }
+                let res = compress_with_cache(&entries[idx].data, &entries[idx].methods);
+                results.lock().unwrap()[idx] = Some(res);
+            });
+        }
+    });
+    let results: Vec<(Vec<u8>, Option<Vec<CompressionReport>>)> = results.into_inner().unwrap()
+        .into_iter()
+        .map(Option::unwrap)
+        .collect();
+
+    let mut input_total = 0;
+    let mut output_total = 0;
+    let mut out = TokenStream::new();
+    for (entry, (compressed_data, reports)) in Iterator::zip(entries.iter(), results.iter()) {
+        report_result(&entry.name, entry.data.len(), compressed_data, reports);
+        input_total += entry.data.len();
+        output_total += compressed_data.len();
+
+        let decl: TokenStream = format!("pub const {}: &[u8] = &", entry.name).parse().unwrap();
+        out.extend(decl);
+        out.extend(data_expr_tokens(compressed_data, entry.source_path.as_deref()));
+        out.extend([TokenTree::Punct(Punct::new(';', Spacing::Alone))]);
+    }
+
+    match get_report_mode() {
+        ReportMode::None => {},
+        _ => println!("batch: {} assets, from {} to {} bytes", entries.len(), input_total, output_total)
+    }
+
+    out
+}
+
+/// Compresses a whole list of assets in one macro invocation and emits
+/// a `pub const <name>: &[u8]` item for each.
+///
+/// Syntax: `compressed_batch!( (<name>, [ <data> ] | path = "<path>", [ <methods> ]), ... )`
+///
+/// Entries follow the same rules as `compressed!`. All entries are
+/// compressed in parallel within this single expansion, so one
+/// invocation saturates the build machine's cores where many separate
+/// `compressed!` invocations would be serialized by macro expansion.
+/// The compression reports are printed per asset with a batch summary.
+#[proc_macro]
+pub fn compressed_batch(stream: proc_macro::TokenStream) -> proc_macro::TokenStream {
+    compressed_batch2(stream.into()).into()
 }
 
 /// Compresses the data passed to it using the given compression methods and
-/// returns an array expression (`[ <data> ]`).
+/// returns an expression of type `[u8; N]` (a dereferenced byte-string
+/// literal, so rustc only has to parse a single token for the data).
+///
+/// Syntax: `compressed!([ <data> ], [ <methods> ], <name>)` or
+/// `compressed!(path = "<path>", [ <methods> ], <name>)`.
 ///
-/// Syntax: `compressed!([ <data> ], [ <methods> ], <name>)`.
+/// With the `path` form, the data is read from the given file, resolved
+/// relative to the crate's `CARGO_MANIFEST_DIR`, and the file is
+/// registered for rebuild tracking, so editing the asset re-runs the
+/// compression. `<name>` defaults to the path in this form.
 ///
 /// `<data>` must be a comma-delimited list of u8 literals. `<methods>` must be a comma-delimited list
 /// contains any of the following identifiers:
-/// - `lz77`: Lempel-Ziv 77 compression
-/// - `rc`: Range Coding compression.
+/// - `lz77`: Lempel-Ziv 77 compression with the small (256 byte) window
+/// - `lz77_64k`: Lempel-Ziv 77 compression with a 64 KB window
+/// - `lz77_lazy`, `lz77_64k_lazy`: like the above with lazy parsing, which
+///   trades encode time for fewer, longer matches
+/// - `rc`: Range Coding compression with the adaptive probability model
+/// - `rc_static`: Range Coding compression with a static probability.
 ///
 /// The compression methods are applied in the given order, but some may be skipped, if it is found
 /// that the size was not reduced after compression.
@@ -241,6 +609,27 @@ mod tests {
     #[test]
     fn compression_success() {
         let res = compressed2(quote!( [0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3], [lz77, rc], "test" ));
-        assert_eq!(res.to_string(), "[99u8 , 234u8 , 53u8 , 29u8 , 44u8 , 57u8 , 90u8 , 89u8 , 54u8 , 6u8 , 88u8 , 96u8 ,]");
+        assert_eq!(res.to_string(), "* b\"u\\x8B\\xE9\\xA2<\\xF4\\xB0\\xE5ikz0\\xC0\"");
+    }
+
+    #[test]
+    fn compression_batch() {
+        let res = crate::compressed_batch2(quote!(
+            (ASSET_A, [0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3], [lz77, rc]),
+            (ASSET_B, path = "Cargo.toml", [lz77_64k_lazy, rc])
+        ));
+        let out = res.to_string();
+        assert!(out.contains("pub const ASSET_A : & [u8] = &"), "unexpected output: {}", out);
+        assert!(out.contains("pub const ASSET_B : & [u8] = &"), "unexpected output: {}", out);
+        assert!(out.contains("include_bytes !"), "unexpected output: {}", out);
+    }
+
+    #[test]
+    fn compression_from_path() {
+        // Any tracked file relative to the manifest dir works for this test.
+        let res = compressed2(quote!( path = "Cargo.toml", [lz77, rc] ));
+        let out = res.to_string();
+        assert!(out.starts_with("{ const _ : & [u8] = include_bytes !"), "unexpected output: {}", out);
+        assert!(out.contains("* b\""), "unexpected output: {}", out);
     }
 }
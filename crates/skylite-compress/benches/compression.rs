@@ -0,0 +1,87 @@
+//! Encode and decode throughput benchmarks over a small corpus of
+//! representative asset types. The corpus files in `benches/corpus/`
+//! are checked in so that results are comparable across machines and
+//! commits; this suite is the regression gate for encoder and decoder
+//! changes.
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+
+use skylite_compress::{compress, make_decoder, make_decoder_static, CompressionMethods, Decoder, LZ77_WINDOW_LARGE, LZ77_WINDOW_SMALL};
+
+const CORPUS: &[(&str, &[u8])] = &[
+    ("tile_map", include_bytes!("corpus/tile_map.bin")),
+    ("sprite_sheet", include_bytes!("corpus/sprite_sheet.bin")),
+    ("save_blob", include_bytes!("corpus/save_blob.bin"))
+];
+
+fn method_chains() -> Vec<(&'static str, Vec<CompressionMethods>)> {
+    vec![
+        ("lz77", vec![CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_SMALL, lazy: false }]),
+        ("lz77_64k", vec![CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_LARGE, lazy: true }]),
+        ("rc", vec![CompressionMethods::RC { adaptive: true }]),
+        ("lz77_64k+rc", vec![CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_LARGE, lazy: true }, CompressionMethods::RC { adaptive: true }])
+    ]
+}
+
+fn bench_encode(c: &mut Criterion) {
+    let mut group = c.benchmark_group("encode");
+    for (data_name, data) in CORPUS {
+        group.throughput(Throughput::Bytes(data.len() as u64));
+        for (chain_name, methods) in method_chains() {
+            let (encoded, _) = compress(data, &methods);
+            eprintln!("{}/{}: {} -> {} bytes ({:.1}%)",
+                data_name, chain_name, data.len(), encoded.len(),
+                encoded.len() as f64 / data.len() as f64 * 100.0);
+
+            group.bench_function(format!("{}/{}", data_name, chain_name), |b| {
+                b.iter(|| compress(data, &methods))
+            });
+        }
+    }
+    group.finish();
+}
+
+fn bench_decode(c: &mut Criterion) {
+    let mut group = c.benchmark_group("decode");
+    for (data_name, data) in CORPUS {
+        group.throughput(Throughput::Bytes(data.len() as u64));
+        for (chain_name, methods) in method_chains() {
+            let (encoded, _) = compress(data, &methods);
+            let mut decoded = vec![0; data.len()];
+            make_decoder(&encoded).decode_bytes(&mut decoded);
+            assert_eq!(&decoded[..], *data, "{}/{} roundtrip failed", data_name, chain_name);
+
+            group.bench_function(format!("{}/{}", data_name, chain_name), |b| {
+                b.iter(|| {
+                    let mut decoder = make_decoder(&encoded);
+                    decoder.decode_bytes(&mut decoded);
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
+fn bench_decode_static(c: &mut Criterion) {
+    let mut group = c.benchmark_group("decode_static");
+    for (data_name, data) in CORPUS {
+        group.throughput(Throughput::Bytes(data.len() as u64));
+        for (chain_name, methods) in method_chains() {
+            let (encoded, _) = compress(data, &methods);
+            let mut decoded = vec![0; data.len()];
+            make_decoder_static(&encoded).decode_bytes(&mut decoded);
+            assert_eq!(&decoded[..], *data, "{}/{} static roundtrip failed", data_name, chain_name);
+
+            group.bench_function(format!("{}/{}", data_name, chain_name), |b| {
+                b.iter(|| {
+                    let mut decoder = make_decoder_static(&encoded);
+                    decoder.decode_bytes(&mut decoded);
+                })
+            });
+        }
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_encode, bench_decode, bench_decode_static);
+criterion_main!(benches);
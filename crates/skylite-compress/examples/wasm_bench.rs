@@ -0,0 +1,46 @@
+//! Decode-throughput benchmark for the shipped wasm module, meant to
+//! run under a wasm runtime via the `bench-wasm` target in the
+//! top-level Makefile (compiled for wasm32-wasip1, executed with
+//! wasmtime). It also runs natively, which is useful for comparing a
+//! host build against the wasm numbers.
+
+use std::time::Instant;
+
+use skylite_compress::{compress, make_decoder_static, CompressionMethods, Decoder, LZ77_WINDOW_LARGE};
+
+const CORPUS: &[(&str, &[u8])] = &[
+    ("tile_map", include_bytes!("../benches/corpus/tile_map.bin")),
+    ("sprite_sheet", include_bytes!("../benches/corpus/sprite_sheet.bin")),
+    ("save_blob", include_bytes!("../benches/corpus/save_blob.bin"))
+];
+
+const ITERATIONS: u32 = 20;
+
+fn main() {
+    let methods = [
+        CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_LARGE, lazy: true },
+        CompressionMethods::RC { adaptive: true }
+    ];
+
+    for (name, data) in CORPUS {
+        let (encoded, _) = compress(data, &methods);
+        let mut decoded = vec![0; data.len()];
+
+        let start = Instant::now();
+        for _ in 0..ITERATIONS {
+            make_decoder_static(&encoded).decode_bytes(&mut decoded);
+        }
+        let elapsed = start.elapsed();
+        assert_eq!(&decoded[..], *data, "{} roundtrip failed", name);
+
+        let throughput = (data.len() as u64 * ITERATIONS as u64) as f64 / elapsed.as_secs_f64() / 1e6;
+        println!(
+            "{}: {} -> {} bytes ({:.1}%), decode {:.2} MB/s",
+            name,
+            data.len(),
+            encoded.len(),
+            encoded.len() as f64 / data.len() as f64 * 100.0,
+            throughput
+        );
+    }
+}
@@ -0,0 +1,225 @@
+/// A growable bit vector packed into u64 words.
+///
+/// Bits are stored in stream order: the first bit of the stream occupies
+/// the most significant bit of the first word. This matches the big-endian
+/// bit order used by the byte-based data streams, so conversions to and
+/// from bytes are plain word loads and stores.
+#[derive(Clone)]
+pub(crate) struct BitVec {
+    words: Vec<u64>,
+    len: usize
+}
+
+impl BitVec {
+    pub fn new() -> BitVec {
+        BitVec {
+            words: Vec::new(),
+            len: 0
+        }
+    }
+
+    pub fn with_capacity(bits: usize) -> BitVec {
+        BitVec {
+            words: Vec::with_capacity((bits + 63) / 64),
+            len: 0
+        }
+    }
+
+    /// Returns the number of bits in the `BitVec`.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Removes all bits, keeping the allocation.
+    pub fn clear(&mut self) {
+        self.words.clear();
+        self.len = 0;
+    }
+
+    /// Appends a single bit.
+    pub fn push(&mut self, bit: bool) {
+        if self.len & 63 == 0 {
+            self.words.push(0);
+        }
+        let word = self.len >> 6;
+        self.words[word] |= (bit as u64) << (63 - (self.len & 63));
+        self.len += 1;
+    }
+
+    /// Appends the lowest `count` bits of `value`, most significant first.
+    pub fn push_bits(&mut self, value: u64, count: usize) {
+        debug_assert!(count <= 64);
+        if count == 0 {
+            return;
+        }
+        let value = if count == 64 { value } else { value & ((1 << count) - 1) };
+
+        let shift = self.len & 63;
+        let available = 64 - shift;
+        if shift == 0 {
+            self.words.push(0);
+        }
+        let word = self.len >> 6;
+        if count <= available {
+            self.words[word] |= value << (available - count);
+        } else {
+            self.words[word] |= value >> (count - available);
+            self.words.push(value << (64 - (count - available)));
+        }
+        self.len += count;
+    }
+
+    /// Returns the bit at the given index.
+    pub fn get(&self, index: usize) -> bool {
+        debug_assert!(index < self.len);
+        (self.words[index >> 6] >> (63 - (index & 63))) & 1 != 0
+    }
+
+    /// Reads up to 64 bits starting at `pos`. The first bit read ends up
+    /// in the most significant position of the returned value's lowest
+    /// `count` bits.
+    pub fn read_bits(&self, pos: usize, count: usize) -> u64 {
+        debug_assert!(count <= 64 && pos + count <= self.len);
+        if count == 0 {
+            return 0;
+        }
+        let word = pos >> 6;
+        let shift = pos & 63;
+        let available = 64 - shift;
+
+        // Shifting out the leading bits leaves zeros in the low positions,
+        // which are filled from the following word if necessary.
+        let head = (self.words[word] << shift) >> (64 - count);
+        if count <= available {
+            head
+        } else {
+            head | (self.words[word + 1] >> (64 - (count - available)))
+        }
+    }
+
+    /// Appends the bits of `data`, most significant bit of each byte first.
+    pub fn extend_from_bytes(&mut self, data: &[u8]) {
+        let mut chunks = data.chunks_exact(8);
+        for chunk in &mut chunks {
+            self.push_bits(u64::from_be_bytes(chunk.try_into().unwrap()), 64);
+        }
+        for b in chunks.remainder() {
+            self.push_bits(*b as u64, 8);
+        }
+    }
+
+    // Only used by tests; the pipeline itself always writes header bits
+    // before the data, so it goes through extend_from_bytes.
+    #[cfg(test)]
+    pub fn from_bytes(data: &[u8]) -> BitVec {
+        let mut out = BitVec::with_capacity(data.len() * 8);
+        out.extend_from_bytes(data);
+        out
+    }
+
+    /// Packs the bits back into bytes. The last byte is padded with 0-bits
+    /// if the length is not a multiple of 8.
+    pub fn to_bytes(&self) -> Vec<u8> {
+        let num_bytes = (self.len + 7) / 8;
+        let mut out = Vec::with_capacity(self.words.len() * 8);
+        for w in &self.words {
+            out.extend_from_slice(&w.to_be_bytes());
+        }
+        out.truncate(num_bytes);
+        out
+    }
+
+    /// Returns the number of 1-bits.
+    pub fn count_ones(&self) -> usize {
+        self.words.iter().map(|w| w.count_ones() as usize).sum()
+    }
+
+    /// Returns the backing words. Bits past `len()` in the last word
+    /// are always 0.
+    pub fn words(&self) -> &[u64] {
+        &self.words
+    }
+
+    /// Builds a `BitVec` directly from backing words. Bits past `len`
+    /// in the last word must be 0.
+    pub fn from_words(words: Vec<u64>, len: usize) -> BitVec {
+        debug_assert!(words.len() == (len + 63) / 64);
+        debug_assert!(len & 63 == 0 || words.last().unwrap() & (u64::MAX >> (len & 63)) == 0);
+        BitVec {
+            words,
+            len
+        }
+    }
+
+    pub fn iter(&self) -> Bits<'_> {
+        Bits {
+            bits: self,
+            index: 0
+        }
+    }
+}
+
+/// Iterator over the bits of a `BitVec`.
+pub(crate) struct Bits<'a> {
+    bits: &'a BitVec,
+    index: usize
+}
+
+impl<'a> Iterator for Bits<'a> {
+    type Item = bool;
+
+    fn next(&mut self) -> Option<bool> {
+        if self.index >= self.bits.len {
+            return None;
+        }
+        let out = self.bits.get(self.index);
+        self.index += 1;
+        Some(out)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::BitVec;
+
+    #[test]
+    fn test_push_and_get() {
+        let mut bits = BitVec::new();
+        for i in 0..100 {
+            bits.push(i % 3 == 0);
+        }
+        assert_eq!(bits.len(), 100);
+        for i in 0..100 {
+            assert_eq!(bits.get(i), i % 3 == 0);
+        }
+    }
+
+    #[test]
+    fn test_bytes_roundtrip() {
+        let data: Vec<u8> = (0..=255).collect();
+        let bits = BitVec::from_bytes(&data);
+        assert_eq!(bits.len(), data.len() * 8);
+        assert_eq!(bits.to_bytes(), data);
+    }
+
+    #[test]
+    fn test_push_bits_across_words() {
+        let mut bits = BitVec::new();
+        bits.push_bits(0x1, 3);
+        bits.push_bits(0xffff_ffff_ffff_ffff, 64);
+        bits.push_bits(0x0, 5);
+        assert_eq!(bits.len(), 72);
+        assert_eq!(bits.to_bytes(), vec![0x3f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xe0]);
+    }
+
+    #[test]
+    fn test_read_bits() {
+        let bits = BitVec::from_bytes(&[0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x55]);
+        assert_eq!(bits.read_bits(0, 8), 0x12);
+        assert_eq!(bits.read_bits(4, 8), 0x23);
+        assert_eq!(bits.read_bits(60, 12), 0x055);
+        assert_eq!(bits.read_bits(0, 64), 0x1234_5678_9abc_def0);
+        assert_eq!(bits.read_bits(4, 64), 0x2345_6789_abcd_ef05);
+    }
+
+}
@@ -1,39 +1,68 @@
+use crate::bitstream::BitVec;
 use crate::Decoder;
 
-fn last_fibonacci_numbers_below(value: usize) -> (usize, usize) {
-    let mut f_prev_prev = 1;
-    let mut f_prev = 1;
-    let mut f = f_prev + f_prev_prev;
-    while value >= f {
-        f_prev_prev = f_prev;
-        f_prev = f;
-        f = f_prev + f_prev_prev;
+/// Fibonacci numbers used for encoding, precomputed up to the largest
+/// value that fits into a u64.
+const FIBONACCI: [u64; 92] = {
+    let mut out = [0_u64; 92];
+    out[0] = 1;
+    out[1] = 2;
+    let mut i = 2;
+    while i < 92 {
+        out[i] = out[i - 1] + out[i - 2];
+        i += 1;
     }
-    (f_prev, f_prev_prev)
+    out
+};
+
+/// Index of the largest table entry that is <= `value`.
+fn largest_fibonacci_index(value: u64) -> usize {
+    let mut top = 0;
+    while top + 1 < FIBONACCI.len() && FIBONACCI[top + 1] <= value {
+        top += 1;
+    }
+    top
 }
 
-pub fn encode_fibonacci(value: usize) -> Vec<bool> {
+/// Appends the Fibonacci code for `value` to `out`, without allocating.
+pub fn encode_fibonacci_into(value: usize, out: &mut BitVec) {
     // 0 cannot be represented as a Fibonacci code, so the
     // value is simply incremented here and decremented in the decoder.
-    let mut to_encode = value + 1;
-    let (mut f, mut f_prev) = last_fibonacci_numbers_below(to_encode);
-    let mut out = vec![true]; // Start with a 'seperator' value of true.
-
-    while f_prev > 0 {
-        if f <= to_encode {
-            to_encode -= f;
-            out.push(true);
-        } else {
-            out.push(false);
+    let mut to_encode = value as u64 + 1;
+    let top = largest_fibonacci_index(to_encode);
+
+    let mut code: u128 = 0;
+    let mut j = top;
+    loop {
+        if FIBONACCI[j] <= to_encode {
+            to_encode -= FIBONACCI[j];
+            code |= 1 << j;
+        }
+        if j == 0 {
+            break;
         }
+        j -= 1;
+    }
 
-        let f_prev_prev = f - f_prev;
-        f = f_prev;
-        f_prev = f_prev_prev;
+    // Emit with the lowest Fibonacci number first, then the 'seperator'
+    // bit of true.
+    let mut j = 0;
+    while j <= top {
+        let chunk = usize::min(64, top + 1 - j);
+        let mut bits: u64 = 0;
+        for b in j..j + chunk {
+            bits = (bits << 1) | ((code >> b) & 1) as u64;
+        }
+        out.push_bits(bits, chunk);
+        j += chunk;
     }
+    out.push(true);
+}
 
-    out.reverse();
-    out
+/// Returns the number of bits that `encode_fibonacci_into` produces for
+/// `value`, without encoding it.
+pub fn encode_fibonacci_len(value: usize) -> usize {
+    largest_fibonacci_index(value as u64 + 1) + 2
 }
 
 pub fn decode_fibonacci(decoder: &mut dyn Decoder) -> usize {
@@ -60,17 +89,18 @@ pub fn decode_fibonacci(decoder: &mut dyn Decoder) -> usize {
 
 #[cfg(test)]
 mod tests {
+    use crate::bitstream::BitVec;
     use crate::Decoder;
 
-    use super::{encode_fibonacci, decode_fibonacci};
+    use super::{encode_fibonacci_into, encode_fibonacci_len, decode_fibonacci};
 
     struct BitVecDecoder<'a> {
-        bits: &'a [bool],
+        bits: &'a BitVec,
         index: usize
     }
 
     impl<'a> BitVecDecoder<'a> {
-        fn new<'b>(bits: &'b [bool]) -> BitVecDecoder {
+        fn new<'b>(bits: &'b BitVec) -> BitVecDecoder<'b> {
             BitVecDecoder {
                 bits,
                 index: 0
@@ -80,19 +110,27 @@ mod tests {
 
     impl<'a> Decoder for BitVecDecoder<'a> {
         fn decode_bit(&mut self) -> bool {
-            let out = self.bits[self.index];
+            let out = self.bits.get(self.index);
             self.index += 1;
             out
         }
     }
 
+    fn encode_fibonacci(value: usize) -> BitVec {
+        let mut out = BitVec::new();
+        encode_fibonacci_into(value, &mut out);
+        out
+    }
+
     #[test]
     fn test_fibonacci_simple() {
         let res = encode_fibonacci(12);
-        assert_eq!(res, vec![false, false, false, false, false, true, true]);
+        assert_eq!(res.iter().collect::<Vec<bool>>(), vec![false, false, false, false, false, true, true]);
+        assert_eq!(encode_fibonacci_len(12), 7);
 
         let res = encode_fibonacci(16);
-        assert_eq!(res, vec![true, false, true, false, false, true, true]);
+        assert_eq!(res.iter().collect::<Vec<bool>>(), vec![true, false, true, false, false, true, true]);
+        assert_eq!(encode_fibonacci_len(16), 7);
 
         let decoded = decode_fibonacci(&mut BitVecDecoder::new(&res));
         assert_eq!(decoded, 16);
@@ -101,9 +139,19 @@ mod tests {
     #[test]
     fn test_encode_zero() {
         let res = encode_fibonacci(0);
-        assert_eq!(res, vec![true, true]);
+        assert_eq!(res.iter().collect::<Vec<bool>>(), vec![true, true]);
+        assert_eq!(encode_fibonacci_len(0), 2);
 
         let decoded = decode_fibonacci(&mut BitVecDecoder::new(&res));
         assert_eq!(decoded, 0);
     }
+
+    #[test]
+    fn test_roundtrip() {
+        for value in (0..4096).chain([100_000, 123_456_789]) {
+            let encoded = encode_fibonacci(value);
+            assert_eq!(encoded.len(), encode_fibonacci_len(value));
+            assert_eq!(decode_fibonacci(&mut BitVecDecoder::new(&encoded)), value);
+        }
+    }
 }
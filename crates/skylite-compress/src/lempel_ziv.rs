@@ -1,16 +1,21 @@
-use crate::{fibonacci_code::{self, decode_fibonacci, encode_fibonacci}, Decoder};
+use crate::{bitstream::BitVec, fibonacci_code::{self, decode_fibonacci, encode_fibonacci_into}, Decoder, MethodStats};
 
-const MAX_RECALL_DIST: usize = 2048;
+/// Decoder window sizes in bytes for the supported window exponents.
+pub const WINDOW_BYTES_SMALL: usize = 1 << (crate::LZ77_WINDOW_SMALL - 3);
+pub const WINDOW_BYTES_LARGE: usize = 1 << (crate::LZ77_WINDOW_LARGE - 3);
 
-struct RingBuffer {
-    content: [u8; MAX_RECALL_DIST / 8],
+/// Ring buffer over the most recent `BYTES * 8` bits of the decoded
+/// stream. The size is a const generic so that constrained targets only
+/// ever instantiate the small window.
+struct RingBuffer<const BYTES: usize> {
+    content: [u8; BYTES],
     input_idx: usize
 }
 
-impl RingBuffer {
-    pub fn new() -> RingBuffer {
+impl<const BYTES: usize> RingBuffer<BYTES> {
+    pub fn new() -> RingBuffer<BYTES> {
         RingBuffer {
-            content: [0; MAX_RECALL_DIST / 8],
+            content: [0; BYTES],
             input_idx: 0
         }
     }
@@ -19,7 +24,7 @@ impl RingBuffer {
         self.content[self.input_idx >> 3] &= !(1 << (self.input_idx & 0x7));
         self.content[self.input_idx >> 3] |= (value as u8) << (self.input_idx & 0x7);
         self.input_idx += 1;
-        if self.input_idx >= MAX_RECALL_DIST {
+        if self.input_idx >= BYTES * 8 {
             self.input_idx = 0;
         }
     }
@@ -28,127 +33,247 @@ impl RingBuffer {
         let idx = if offset + 1 <= self.input_idx {
             self.input_idx - (offset + 1)
         } else {
-            MAX_RECALL_DIST - (offset + 1 - self.input_idx)
+            BYTES * 8 - (offset + 1 - self.input_idx)
         };
 
         (self.content[idx >> 3] & (1 << (idx &0x7))) != 0
     }
-}
-
-struct LZ77Encoder {
-    pending_symbols: usize,
-    buffer: RingBuffer,
-    recall_distances: Vec<usize>,
-    recall_length: usize,
-    out: Vec<bool>
-}
 
-impl LZ77Encoder {
+    /// Reads `count` consecutive stored bits, starting `offset + 1` bits
+    /// behind the write cursor. The first bit ends up in the most
+    /// significant position of the returned value's low `count` bits.
+    /// Equivalent to `count` interleaved read/push steps at a fixed
+    /// offset, which requires `count <= offset + 1`.
+    pub fn read_run(&self, offset: usize, count: usize) -> u64 {
+        debug_assert!(count <= 64 && count <= offset + 1);
+        let mut idx = if offset + 1 <= self.input_idx {
+            self.input_idx - (offset + 1)
+        } else {
+            BYTES * 8 - (offset + 1 - self.input_idx)
+        };
 
-    pub fn new() -> LZ77Encoder {
-        LZ77Encoder {
-            pending_symbols: 0,
-            buffer: RingBuffer::new(),
-            recall_distances: Vec::new(),
-            recall_length: 0,
-            out: Vec::new()
+        let mut out: u64 = 0;
+        let mut remaining = count;
+        while remaining > 0 {
+            let bit = idx & 0x7;
+            let take = usize::min(remaining, 8 - bit);
+            // Bits are stored lowest-first within a byte; the output
+            // convention wants the first bit at the top, so each chunk
+            // is bit-reversed.
+            let chunk = (self.content[idx >> 3] >> bit) & ((1_u16 << take) - 1) as u8;
+            let reversed = chunk.reverse_bits() >> (8 - take);
+            out = (out << take) | reversed as u64;
+            remaining -= take;
+            idx += take;
+            if idx >= BYTES * 8 {
+                idx = 0;
+            }
         }
+        out
     }
 
-    fn emit_bits(&mut self, bits: &[bool]) {
-        for b in bits {
-            self.out.push(*b);
+    /// Pushes the low `count` bits of `bits`, most significant first -
+    /// the same convention `read_run` returns.
+    pub fn push_run(&mut self, bits: u64, count: usize) {
+        debug_assert!(count <= 64);
+        let mut remaining = count;
+        while remaining > 0 {
+            let bit = self.input_idx & 0x7;
+            let take = usize::min(remaining, 8 - bit);
+            let mask = ((1_u16 << take) - 1) as u8;
+            let segment = ((bits >> (remaining - take)) & mask as u64) as u8;
+            let reversed = segment.reverse_bits() >> (8 - take);
+
+            let byte = self.input_idx >> 3;
+            self.content[byte] &= !(mask << bit);
+            self.content[byte] |= reversed << bit;
+
+            remaining -= take;
+            self.input_idx += take;
+            if self.input_idx >= BYTES * 8 {
+                self.input_idx = 0;
+            }
         }
     }
+}
 
-    fn emit_direct_data_code(&mut self, len: usize) {
-        if len == 0 {
-            return;
-        }
-
-        self.out.push(false);
-        self.out.append(&mut encode_fibonacci(len));
+/// Number of bits that make up the match context for the match finder.
+/// Candidate positions are indexed by the exact value of the next
+/// `MATCH_CONTEXT_BITS` bits, so every candidate is guaranteed to match
+/// at least this many bits. Shorter matches are never profitable to
+/// encode as recall codes anyway.
+const MATCH_CONTEXT_BITS: usize = 16;
+
+/// Maximum number of chain links followed per position. Bounds the
+/// worst-case encode time on highly repetitive data.
+const MAX_CHAIN_DEPTH: usize = 64;
+
+const NO_POSITION: u32 = u32::MAX;
+
+/// Hash-chain index over the sliding window.
+///
+/// For every inserted position, `head` records the most recent position
+/// whose next `MATCH_CONTEXT_BITS` bits have the same value, and `prev`
+/// links each window slot to the previous position with the same context.
+/// Finding match candidates is therefore a table lookup plus a chain
+/// walk instead of a scan over the whole window.
+struct MatchFinder {
+    head: Vec<u32>,
+    prev: Vec<u32>,
+    window: usize
+}
 
-        for i in 0 .. len {
-            self.out.push(self.buffer.read(self.pending_symbols - i - 1));
+impl MatchFinder {
+    fn new(window: usize) -> MatchFinder {
+        MatchFinder {
+            head: vec![NO_POSITION; 1 << MATCH_CONTEXT_BITS],
+            prev: vec![NO_POSITION; window],
+            window
         }
-        self.pending_symbols -= len;
     }
 
-    fn generate_recall_code(&self, distance: usize, len: usize) -> Vec<bool>{
-        if len == 0 {
-            return vec![];
+    fn insert(&mut self, data: &BitVec, pos: usize) {
+        if pos + MATCH_CONTEXT_BITS > data.len() {
+            return;
         }
-
-        let len_fibonacci = fibonacci_code::encode_fibonacci(len);
-        let distance_fibonacci = fibonacci_code::encode_fibonacci(distance);
-
-        [vec![true], len_fibonacci, distance_fibonacci].into_iter().flatten().collect()
+        let context = data.read_bits(pos, MATCH_CONTEXT_BITS) as usize;
+        self.prev[pos % self.window] = self.head[context];
+        self.head[context] = pos as u32;
     }
 
-    pub fn push_symbol(&mut self, symbol: bool) {
-        if !self.recall_distances.is_empty() {
-            let current_max_recall_distance = *self.recall_distances.iter().max().unwrap();
-            self.recall_distances.retain(|dist| (self.buffer.read(*dist) == symbol));
-            if self.recall_distances.is_empty() {
-                let recall_code = self.generate_recall_code(current_max_recall_distance, self.recall_length);
-                if recall_code.len() < self.recall_length {
-                    self.emit_direct_data_code(self.pending_symbols - self.recall_length);
-                    self.emit_bits(&recall_code);
-                    self.pending_symbols -= self.recall_length;
-                }
-                self.recall_length = 0;
-            } else {
-                self.recall_length += 1;
+    /// Returns the number of bits that are equal at `candidate` and `pos`.
+    fn match_length(data: &BitVec, candidate: usize, pos: usize) -> usize {
+        let max_len = data.len() - pos;
+        let mut len = 0;
+        while len < max_len {
+            let chunk = usize::min(64, max_len - len);
+            let a = data.read_bits(candidate + len, chunk);
+            let b = data.read_bits(pos + len, chunk);
+            if a != b {
+                return len + (a ^ b).leading_zeros() as usize - (64 - chunk);
             }
+            len += chunk;
         }
+        max_len
+    }
 
-        if self.recall_distances.is_empty() {
-            self.recall_distances = (0 .. MAX_RECALL_DIST).filter(|dist| self.buffer.read(*dist) == symbol).collect();
-            if !self.recall_distances.is_empty() {
-                self.recall_length = 1;
+    /// Finds the longest match for the bits at `pos`, returned as a
+    /// (distance, length) pair. Of equally long matches, the one with the
+    /// smallest distance is used.
+    fn find_match(&self, data: &BitVec, pos: usize) -> Option<(usize, usize)> {
+        if pos + MATCH_CONTEXT_BITS > data.len() {
+            return None;
+        }
+        let context = data.read_bits(pos, MATCH_CONTEXT_BITS) as usize;
+        let min_pos = pos.saturating_sub(self.window);
+
+        let mut best: Option<(usize, usize)> = None;
+        let mut candidate = self.head[context];
+        for _ in 0..MAX_CHAIN_DEPTH {
+            if candidate == NO_POSITION || (candidate as usize) < min_pos {
+                break;
             }
+            let len = Self::match_length(data, candidate as usize, pos);
+            if best.map(|(_, best_len)| len > best_len).unwrap_or(true) {
+                best = Some((pos - candidate as usize - 1, len));
+            }
+            candidate = self.prev[candidate as usize % self.window];
         }
+        best
+    }
+}
 
-        self.buffer.push(symbol);
-        self.pending_symbols += 1;
+fn emit_direct_data_code(out: &mut BitVec, data: &BitVec, from: usize, to: usize) {
+    if to == from {
+        return;
+    }
 
-        // Check if an output needs to be forced, to prevent the ring buffer from overwriting unprocessed data
-        if self.pending_symbols >= MAX_RECALL_DIST {
-            self.emit_direct_data_code(self.pending_symbols - self.recall_length);
-        }
+    out.push(false);
+    encode_fibonacci_into(to - from, out);
 
-        if self.recall_length >= MAX_RECALL_DIST {
-            let current_max_recall_distance = *self.recall_distances.iter().max().unwrap();
-            let recall_code = self.generate_recall_code(current_max_recall_distance, self.recall_length);
-            self.emit_bits(&recall_code);
-            self.pending_symbols -= self.recall_length;
-            self.recall_distances.clear();
-            self.recall_length = 0;
-        }
+    let mut pos = from;
+    while pos < to {
+        let chunk = usize::min(64, to - pos);
+        out.push_bits(data.read_bits(pos, chunk), chunk);
+        pos += chunk;
     }
+}
 
-    pub fn finish(mut self) -> Vec<bool> {
-        if self.pending_symbols > 0 {
-            self.emit_direct_data_code(self.pending_symbols - self.recall_length);
-        }
+fn emit_recall_code(out: &mut BitVec, distance: usize, len: usize) {
+    out.push(true);
+    encode_fibonacci_into(len, out);
+    encode_fibonacci_into(distance, out);
+}
 
-        if self.recall_length > 0 {
-            let current_max_recall_distance = *self.recall_distances.iter().max().unwrap();
-            let recall_code = self.generate_recall_code(current_max_recall_distance, self.recall_length);
-            self.emit_bits(&recall_code);
-        }
+/// Number of bits a recall code for the given match would occupy.
+fn recall_code_len(distance: usize, len: usize) -> usize {
+    1 + fibonacci_code::encode_fibonacci_len(len) + fibonacci_code::encode_fibonacci_len(distance)
+}
 
-        self.out
+/// The best match at `pos`, if encoding it actually saves bits over
+/// emitting the matched bits as literals.
+fn profitable_match(finder: &MatchFinder, data: &BitVec, pos: usize) -> Option<(usize, usize)> {
+    match finder.find_match(data, pos) {
+        Some((distance, len)) if recall_code_len(distance, len) < len => Some((distance, len)),
+        _ => None
     }
 }
 
-pub fn encode_lz77<'a>(data: &[bool]) -> Vec<bool> {
-    let mut encoder = LZ77Encoder::new();
-    for b in data {
-        encoder.push_symbol(*b);
+/// Net number of bits a recall code saves over emitting the match as
+/// literals.
+fn net_saved(distance: usize, len: usize) -> usize {
+    len - recall_code_len(distance, len)
+}
+
+/// Encodes `data` with a window of `1 << window_exp` bits. The window
+/// exponent is recorded at the start of the stream so that the decoder
+/// side can allocate a matching window.
+///
+/// With `lazy` set, the encoder defers a match by one symbol whenever
+/// the match starting at the next position saves more bits (measured
+/// with the actual Fibonacci code lengths). This trades a little
+/// encode time for fewer, longer recalls - which also means fewer
+/// opcode decodes at load time.
+pub fn encode_lz77(data: &BitVec, out: &mut BitVec, window_exp: u8, lazy: bool) -> MethodStats {
+    let mut finder = MatchFinder::new(1 << window_exp);
+    encode_fibonacci_into(window_exp as usize, out);
+    let mut literal_start = 0;
+    let mut pos = 0;
+    let mut matches = 0;
+    let mut match_bits = 0;
+
+    while pos < data.len() {
+        if let Some((distance, len)) = profitable_match(&finder, data, pos) {
+            let mut insert_from = pos;
+            if lazy {
+                finder.insert(data, pos);
+                insert_from = pos + 1;
+                if let Some((next_distance, next_len)) = profitable_match(&finder, data, pos + 1) {
+                    if net_saved(next_distance, next_len) > net_saved(distance, len) {
+                        // Defer; the current symbol joins the literal run.
+                        pos += 1;
+                        continue;
+                    }
+                }
+            }
+
+            emit_direct_data_code(out, data, literal_start, pos);
+            emit_recall_code(out, distance, len);
+            matches += 1;
+            match_bits += len;
+            for p in insert_from..pos + len {
+                finder.insert(data, p);
+            }
+            pos += len;
+            literal_start = pos;
+        } else {
+            finder.insert(data, pos);
+            pos += 1;
+        }
     }
-    return encoder.finish();
+
+    emit_direct_data_code(out, data, literal_start, data.len());
+    MethodStats::Lz77 { matches, match_bits }
 }
 
 enum LZ77Opcode {
@@ -156,15 +281,15 @@ enum LZ77Opcode {
     Recall(usize, usize)
 }
 
-pub struct LZ77Decoder<'a> {
-    source: Box<dyn Decoder + 'a>,
-    buffer: RingBuffer,
+pub struct LZ77Decoder<S: Decoder, const WINDOW_BYTES: usize> {
+    source: S,
+    buffer: RingBuffer<WINDOW_BYTES>,
     opcode: LZ77Opcode,
     progress: usize
 }
 
-impl<'a> LZ77Decoder<'a> {
-    pub fn new<'b>(source: Box<dyn Decoder + 'b>) -> LZ77Decoder<'b> {
+impl<S: Decoder, const WINDOW_BYTES: usize> LZ77Decoder<S, WINDOW_BYTES> {
+    pub fn new(source: S) -> LZ77Decoder<S, WINDOW_BYTES> {
         LZ77Decoder {
             source,
             buffer: RingBuffer::new(),
@@ -172,9 +297,21 @@ impl<'a> LZ77Decoder<'a> {
             progress: 0
         }
     }
+
+    fn fetch_opcode(&mut self) {
+        let code_type = self.source.decode_bit();
+        let len = decode_fibonacci(&mut self.source);
+        if code_type {
+            let distance = decode_fibonacci(&mut self.source);
+            self.opcode = LZ77Opcode::Recall(distance, len);
+        } else {
+            self.opcode = LZ77Opcode::DirectData(len);
+        }
+        self.progress = 0;
+    }
 }
 
-impl<'a> Decoder for LZ77Decoder<'a> {
+impl<S: Decoder, const WINDOW_BYTES: usize> Decoder for LZ77Decoder<S, WINDOW_BYTES> {
 
     fn decode_bit(&mut self) -> bool {
         let len = match self.opcode {
@@ -183,15 +320,7 @@ impl<'a> Decoder for LZ77Decoder<'a> {
         };
 
         if self.progress >= len {
-            let code_type = self.source.decode_bit();
-            let len = decode_fibonacci(self.source.as_mut());
-            if code_type {
-                let distance = decode_fibonacci(self.source.as_mut());
-                self.opcode = LZ77Opcode::Recall(distance, len);
-            } else {
-                self.opcode = LZ77Opcode::DirectData(len);
-            }
-            self.progress = 0;
+            self.fetch_opcode();
         }
 
         let out = match self.opcode {
@@ -202,6 +331,53 @@ impl<'a> Decoder for LZ77Decoder<'a> {
         self.progress += 1;
         out
     }
+
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        for b in out.iter_mut() {
+            let mut v: u32 = 0;
+            let mut bits = 0;
+            // Resolve the current opcode once per run instead of once
+            // per bit, so a long recall or direct data code does not
+            // re-dispatch for every bit it produces.
+            while bits < 8 {
+                let len = match self.opcode {
+                    LZ77Opcode::DirectData(len) => len,
+                    LZ77Opcode::Recall(_, len) => len
+                };
+                if self.progress >= len {
+                    self.fetch_opcode();
+                    continue;
+                }
+
+                let run = usize::min(len - self.progress, 8 - bits);
+                match self.opcode {
+                    LZ77Opcode::DirectData(_) => for _ in 0..run {
+                        let bit = self.source.decode_bit();
+                        self.buffer.push(bit);
+                        v = (v << 1) | bit as u32;
+                    },
+                    LZ77Opcode::Recall(distance, _) => {
+                        // Recalls copy whole chunks between the read and
+                        // write positions of the ring buffer instead of
+                        // moving single bits. Chunks are capped at the
+                        // recall distance, which is what an overlapping
+                        // copy (short period, long match) requires.
+                        let mut taken = 0;
+                        while taken < run {
+                            let chunk = usize::min(run - taken, distance + 1);
+                            let copied = self.buffer.read_run(distance, chunk);
+                            self.buffer.push_run(copied, chunk);
+                            v = (v << chunk) | copied as u32;
+                            taken += chunk;
+                        }
+                    }
+                }
+                self.progress += run;
+                bits += run;
+            }
+            *b = v as u8;
+        }
+    }
 }
 
 #[cfg(test)]
@@ -215,7 +391,51 @@ mod tests {
         quickcheck, TestResult
     };
 
-    use crate::{bits_to_data, data_to_bits, decode_symbol, encode_lz77, lempel_ziv::LZ77Decoder, RawSliceDecoder};
+    use crate::{bitstream::BitVec, decode_symbol, fibonacci_code::decode_fibonacci, lempel_ziv::{LZ77Decoder, WINDOW_BYTES_LARGE, WINDOW_BYTES_SMALL}, RawSliceDecoder, LZ77_WINDOW_LARGE, LZ77_WINDOW_SMALL};
+
+    use super::{encode_lz77, RingBuffer};
+
+    #[test]
+    fn test_ring_buffer_runs() {
+        // Run reads and writes must behave exactly like interleaved
+        // bitwise read/push sequences, including across the wrap-around.
+        let mut bitwise: RingBuffer<4> = RingBuffer::new();
+        let mut runs: RingBuffer<4> = RingBuffer::new();
+        for i in 0..48 {
+            bitwise.push(i % 3 == 0);
+            runs.push(i % 3 == 0);
+        }
+
+        for (offset, count) in [(11, 7), (13, 14), (0, 1), (30, 20)] {
+            let mut expected: u64 = 0;
+            for _ in 0..count {
+                let bit = bitwise.read(offset);
+                bitwise.push(bit);
+                expected = (expected << 1) | bit as u64;
+            }
+
+            let copied = runs.read_run(offset, usize::min(count, offset + 1));
+            runs.push_run(copied, usize::min(count, offset + 1));
+            let mut got = copied;
+            let mut taken = usize::min(count, offset + 1);
+            while taken < count {
+                let chunk = usize::min(count - taken, offset + 1);
+                let copied = runs.read_run(offset, chunk);
+                runs.push_run(copied, chunk);
+                got = (got << chunk) | copied;
+                taken += chunk;
+            }
+            assert_eq!(got, expected, "offset {} count {}", offset, count);
+        }
+    }
+
+    /// Consumes the window exponent header and checks it against the
+    /// expectation, like make_decoder does.
+    fn make_lz77_source(encoded: &[u8], window_exp: u8) -> RawSliceDecoder<'_> {
+        let mut source = RawSliceDecoder::new(encoded);
+        assert_eq!(decode_fibonacci(&mut source), window_exp as usize);
+        source
+    }
 
     #[test]
     fn test_compression() {
@@ -229,12 +449,14 @@ mod tests {
             })
             .collect();
 
-        let encoded = bits_to_data(&encode_lz77(&data_to_bits(&data)));
+        let mut bits = BitVec::new();
+        encode_lz77(&BitVec::from_bytes(&data), &mut bits, LZ77_WINDOW_SMALL, false);
+        let encoded = bits.to_bytes();
 
-        let expectation = &[3, 0, 25, 29, 145, 129, 85, 84, 137, 209, 117, 72, 152, 144, 78, 169, 19, 18, 9, 196, 130, 98, 65, 48];
+        let expectation = &[172, 12, 0, 100, 118, 70, 5, 86, 39, 212, 148, 142, 139];
         assert_eq!(&encoded[..], expectation);
 
-        let mut decoder = LZ77Decoder::new(Box::new(RawSliceDecoder::new(&encoded)));
+        let mut decoder = LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(make_lz77_source(&encoded, LZ77_WINDOW_SMALL));
         let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(data.len()).collect();
         assert_eq!(decoded[..], data);
     }
@@ -250,9 +472,29 @@ mod tests {
                 return TestResult::discard();
             }
 
-            let encoded = bits_to_data(&encode_lz77(&data_to_bits(&expanded_data)));
+            let mut bits = BitVec::new();
+            encode_lz77(&BitVec::from_bytes(&expanded_data), &mut bits, LZ77_WINDOW_SMALL, false);
+            let encoded = bits.to_bytes();
+            let mut decoder = LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(make_lz77_source(&encoded, LZ77_WINDOW_SMALL));
+            let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(expanded_data.len()).collect();
+            if decoded.cmp(&expanded_data) != Ordering::Equal {
+                return TestResult::failed();
+            }
+
+            let mut bits = BitVec::new();
+            encode_lz77(&BitVec::from_bytes(&expanded_data), &mut bits, LZ77_WINDOW_LARGE, false);
+            let encoded = bits.to_bytes();
+            let mut decoder = LZ77Decoder::<_, WINDOW_BYTES_LARGE>::new(make_lz77_source(&encoded, LZ77_WINDOW_LARGE));
+            let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(expanded_data.len()).collect();
+            if decoded.cmp(&expanded_data) != Ordering::Equal {
+                return TestResult::failed();
+            }
 
-            let mut decoder = LZ77Decoder::new(Box::new(RawSliceDecoder::new(&encoded)));
+            // The lazy parse emits a different, but compatible, stream.
+            let mut bits = BitVec::new();
+            encode_lz77(&BitVec::from_bytes(&expanded_data), &mut bits, LZ77_WINDOW_SMALL, true);
+            let encoded = bits.to_bytes();
+            let mut decoder = LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(make_lz77_source(&encoded, LZ77_WINDOW_SMALL));
             let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(expanded_data.len()).collect();
             return TestResult::from_bool(decoded.cmp(&expanded_data) == Ordering::Equal);
         }
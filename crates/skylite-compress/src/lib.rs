@@ -1,8 +1,9 @@
 #[cfg(feature = "rc")]
 mod range_coding;
-use std::{mem::size_of, ops::{BitAnd, BitOrAssign, ShlAssign, Shr}};
+use std::{mem::size_of, ops::{BitOrAssign, ShlAssign}, sync::{atomic::{self, AtomicUsize}, Mutex}, thread, time::Duration};
 
-use fibonacci_code::{decode_fibonacci, encode_fibonacci};
+use bitstream::BitVec;
+use fibonacci_code::{decode_fibonacci, encode_fibonacci_into};
 #[cfg(feature = "rc")]
 use range_coding::*;
 
@@ -12,44 +13,9 @@ mod lempel_ziv;
 use lempel_ziv::*;
 
 mod bit_prediction;
+mod bitstream;
 mod fibonacci_code;
 
-pub(crate) fn symbol_to_bits<T>(symbol: T) -> Vec<bool>
-where
-    T: BitAnd<T, Output = T> + Shr<usize, Output = T> + From<u8> + PartialEq + Copy,
-{
-    let zero = Into::<T>::into(0);
-    let one = Into::<T>::into(1);
-    (0..(size_of::<T>() * 8))
-        .rev()
-        .map(|b| ((symbol >> b) & one) != zero)
-        .collect()
-}
-
-pub(crate) fn data_to_bits(data: &[u8]) -> Vec<bool> {
-    data.iter()
-        .flat_map(|v| (0..8)
-            .rev()
-            .map(move |bit| (v & (1 << bit)) != 0))
-        .collect()
-}
-
-pub(crate) fn bits_to_data(bits: &[bool]) -> Vec<u8> {
-    let mut bit_index = 0;
-    let mut out = Vec::new();
-    for b in bits {
-        if bit_index == 0 {
-            out.push(0);
-        }
-        *out.last_mut().unwrap() |= (*b as u8) << (7 - bit_index);
-        bit_index += 1;
-        if bit_index >= 8 {
-            bit_index = 0;
-        }
-    }
-    out
-}
-
 /// A `Decoder` decodes a compressed data stream.
 pub trait Decoder {
 
@@ -59,39 +25,99 @@ pub trait Decoder {
     /// has ended, so the length of the original data must be
     /// known to the caller.
     fn decode_bit(&mut self) -> bool;
+
+    /// Decode the next `out.len()` bytes from the data stream.
+    ///
+    /// This is equivalent to assembling each byte from eight `decode_bit`
+    /// calls, but implementations can move whole bytes or runs per call,
+    /// which avoids most of the virtual calls through a decoder stack.
+    /// Like `decode_bit`, this method does not detect the end of the
+    /// meaningful data.
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        for b in out.iter_mut() {
+            let mut v = 0;
+            for _ in 0..8 {
+                v = (v << 1) | self.decode_bit() as u8;
+            }
+            *b = v;
+        }
+    }
+}
+
+impl<'a> Decoder for Box<dyn Decoder + 'a> {
+    fn decode_bit(&mut self) -> bool {
+        self.as_mut().decode_bit()
+    }
+
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        self.as_mut().decode_bytes(out)
+    }
 }
 
 pub(crate) fn decode_symbol<T>(decoder: &mut dyn Decoder) -> T
 where T: ShlAssign<u8> + BitOrAssign<T> + Default + From<bool>
 {
+    let mut buf = [0_u8; size_of::<u64>()];
+    let bytes = &mut buf[..size_of::<T>()];
+    decoder.decode_bytes(bytes);
+
     let mut out = T::default();
-    for _ in 0..(size_of::<T>() * 8) {
-        out <<= 1;
-        out |= decoder.decode_bit().into();
+    for byte in bytes {
+        for bit in (0..8).rev() {
+            out <<= 1;
+            out |= ((*byte >> bit) & 1 != 0).into();
+        }
     }
     out
 }
 
-struct RawSliceDecoder<'a> {
+/// `Decoder` over raw, uncompressed data. This is the innermost layer of
+/// every decoder stack and also serves as the cursor into the compressed
+/// data: higher layers can use the seek operations to implement random
+/// access into an asset without decoding from the start.
+pub struct RawSliceDecoder<'a> {
     data: &'a [u8],
-    index: u16,
+    index: usize,
     bit_index: u8
 }
 
 impl<'a> RawSliceDecoder<'a> {
-    fn new<'b>(data: &'b [u8]) -> RawSliceDecoder<'b> {
+    pub fn new<'b>(data: &'b [u8]) -> RawSliceDecoder<'b> {
         RawSliceDecoder {
             data,
             index: 0,
             bit_index: 0
         }
     }
+
+    /// Returns the current read position in bits from the start of the data.
+    pub fn bit_position(&self) -> usize {
+        self.index * 8 + self.bit_index as usize
+    }
+
+    /// Moves the read position back to the start of the data.
+    pub fn reset(&mut self) {
+        self.index = 0;
+        self.bit_index = 0;
+    }
+
+    /// Moves the read position to the given bit offset. Positions past the
+    /// end of the data are allowed and decode as 0-bits.
+    pub fn seek(&mut self, bit_position: usize) {
+        self.index = bit_position >> 3;
+        self.bit_index = (bit_position & 0x7) as u8;
+    }
+
+    /// Advances the read position by `count` bits without decoding them.
+    pub fn skip_bits(&mut self, count: usize) {
+        self.seek(self.bit_position() + count);
+    }
 }
 
 impl<'a> Decoder for RawSliceDecoder<'a> {
     fn decode_bit(&mut self) -> bool {
-        if (self.index as usize) < self.data.len() {
-            let out = self.data[self.index as usize] & (1 << (7 - self.bit_index));
+        if self.index < self.data.len() {
+            let out = self.data[self.index] & (1 << (7 - self.bit_index));
             self.bit_index += 1;
             if self.bit_index >= 8 {
                 self.bit_index = 0;
@@ -102,25 +128,114 @@ impl<'a> Decoder for RawSliceDecoder<'a> {
             false
         }
     }
+
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        if self.bit_index == 0 {
+            // Byte-aligned: a plain copy, padded with 0-bytes past the end
+            // of the input, like decode_bit pads with 0-bits.
+            let available = usize::min(out.len(), self.data.len().saturating_sub(self.index));
+            out[..available].copy_from_slice(&self.data[self.index..self.index + available]);
+            out[available..].fill(0);
+            self.index += available;
+        } else {
+            // Unaligned: each output byte spans two input bytes.
+            for b in out.iter_mut() {
+                let high = if self.index < self.data.len() {
+                    self.data[self.index] << self.bit_index
+                } else {
+                    0
+                };
+                let low = if self.index + 1 < self.data.len() {
+                    self.data[self.index + 1] >> (8 - self.bit_index)
+                } else {
+                    0
+                };
+                *b = high | low;
+                if self.index < self.data.len() {
+                    self.index += 1;
+                }
+            }
+        }
+    }
 }
 
-#[repr(u8)]
+/// Window size exponents supported by the LZ77 decoders. The window size
+/// in bits is `1 << exp`. `LZ77_WINDOW_SMALL` keeps the original 256-byte
+/// decoder footprint for constrained targets, `LZ77_WINDOW_LARGE` is a
+/// 64 KB window for large assets.
+#[cfg(feature = "lz77")]
+pub const LZ77_WINDOW_SMALL: u8 = 11;
+#[cfg(feature = "lz77")]
+pub const LZ77_WINDOW_LARGE: u8 = 19;
+
 #[derive(Clone, Copy)]
 pub enum CompressionMethods {
-    Raw = 0,
-    #[cfg(feature = "lz77")] LZ77 = 1,
-    #[cfg(feature = "rc")] RC = 2
+    Raw,
+    #[cfg(feature = "lz77")] LZ77 { window_exp: u8, lazy: bool },
+    #[cfg(feature = "rc")] RC { adaptive: bool }
+}
+
+impl CompressionMethods {
+    /// Method tag recorded in the compressed stream.
+    fn tag(&self) -> usize {
+        match self {
+            CompressionMethods::Raw => 0,
+            #[cfg(feature = "lz77")] CompressionMethods::LZ77 { .. } => 1,
+            #[cfg(feature = "rc")] CompressionMethods::RC { .. } => 2
+        }
+    }
+}
+
+/// Method-specific statistics gathered while encoding.
+#[derive(Clone, Copy)]
+pub enum MethodStats {
+    None,
+    #[cfg(feature = "lz77")]
+    Lz77 {
+        /// Number of recall codes emitted.
+        matches: usize,
+        /// Total number of input bits covered by recall codes.
+        match_bits: usize
+    },
+    #[cfg(feature = "rc")]
+    Rc {
+        /// Number of byte renormalizations performed by the range coder.
+        renormalizations: usize
+    }
+}
+
+impl MethodStats {
+    /// Combines the statistics of two blocks of the same method.
+    fn merge(&self, other: &MethodStats) -> MethodStats {
+        match (self, other) {
+            #[cfg(feature = "lz77")]
+            (MethodStats::Lz77 { matches: a, match_bits: ab }, MethodStats::Lz77 { matches: b, match_bits: bb }) =>
+                MethodStats::Lz77 { matches: a + b, match_bits: ab + bb },
+            #[cfg(feature = "rc")]
+            (MethodStats::Rc { renormalizations: a }, MethodStats::Rc { renormalizations: b }) =>
+                MethodStats::Rc { renormalizations: a + b },
+            _ => MethodStats::None
+        }
+    }
 }
 
 /// Information on the invocation of a compression method.
+#[derive(Clone)]
 pub struct CompressionReport {
     /// The compression method used.
     pub method: CompressionMethods,
-    /// The size of the data after compression. If this method was skipped,
+    /// The size of the data before this method ran, in bits.
+    pub input_size: usize,
+    /// The size of the data after compression, in bits. If this method was skipped,
     /// this will hold the size of the uncompressed data.
     pub compressed_size: usize,
     /// Whether this method was skipped within `compress`
-    pub skipped: bool
+    pub skipped: bool,
+    /// Wall time spent running the method. Zero on targets without a
+    /// monotonic clock (wasm32).
+    pub time: Duration,
+    /// Encoder statistics for this method.
+    pub stats: MethodStats
 }
 
 /// Compresses the data using the list of `CompressionMethods`.
@@ -130,48 +245,420 @@ pub struct CompressionReport {
 /// The function returns both the compressed data and a list of `CompressionReport`s,
 /// with one entry for each compression method.
 pub fn compress(data: &[u8], methods: &[CompressionMethods]) -> (Vec<u8>, Vec<CompressionReport>) {
-    let mut out = data_to_bits(data);
+    let mut current = BitVec::with_capacity(data.len() * 8 + 16);
+    current.push(true);
+    current.push(true);
+    // Declared length of the original data, so that consumers can tell
+    // where the stream ends.
+    encode_fibonacci_into(data.len(), &mut current);
+    current.extend_from_bytes(data);
+
+    // The method chain ping-pongs between two buffers: each stage writes
+    // its tag and payload into the scratch buffer, and the buffers swap
+    // roles when the stage is accepted. Nothing is ever spliced or
+    // re-copied, and peak memory stays at two buffers.
+    let mut scratch = BitVec::new();
+
     let mut reports = Vec::with_capacity(methods.len());
-    out.insert(0, true);
-    out.insert(0, true);
     for method in methods {
-        let mut new = match method {
-            CompressionMethods::Raw => out.clone(),
-            #[cfg(feature = "lz77")] CompressionMethods::LZ77 => encode_lz77(&out),
-            #[cfg(feature = "rc")] CompressionMethods::RC => encode_rc(&out)
+        let input_size = current.len();
+        let start = method_clock();
+        scratch.clear();
+        encode_fibonacci_into(method.tag(), &mut scratch);
+        let tag_len = scratch.len();
+        let (payload_len, stats) = match method {
+            // Raw can never shrink the data, so it is always skipped;
+            // there is nothing to encode.
+            CompressionMethods::Raw => (current.len(), MethodStats::None),
+            #[cfg(feature = "lz77")] CompressionMethods::LZ77 { window_exp, lazy } => {
+                let stats = encode_lz77(&current, &mut scratch, *window_exp, *lazy);
+                (scratch.len() - tag_len, stats)
+            },
+            #[cfg(feature = "rc")] CompressionMethods::RC { adaptive } => {
+                let stats = encode_rc(&current, &mut scratch, *adaptive);
+                (scratch.len() - tag_len, stats)
+            }
         };
-        if new.len() + 1 < out.len() {
-            let mut tag = encode_fibonacci(method.to_owned() as usize);
-            tag.append(&mut new);
-            out = tag;
-            reports.push(CompressionReport { method: *method, compressed_size: out.len(), skipped: false });
-        } else {
-            reports.push(CompressionReport { method: *method, compressed_size: out.len(), skipped: true });
+        let time = method_clock_elapsed(start);
+        let skipped = payload_len + 1 >= current.len();
+        if !skipped {
+            std::mem::swap(&mut current, &mut scratch);
         }
+        reports.push(CompressionReport { method: *method, input_size, compressed_size: current.len(), skipped, time, stats });
+    }
+    (current.to_bytes(), reports)
+}
+
+// Instant is unimplemented on wasm32-unknown-unknown, so method timing
+// reports zero there.
+#[cfg(not(target_arch = "wasm32"))]
+fn method_clock() -> Option<std::time::Instant> {
+    Some(std::time::Instant::now())
+}
+
+#[cfg(target_arch = "wasm32")]
+fn method_clock() -> Option<()> {
+    None
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+fn method_clock_elapsed(start: Option<std::time::Instant>) -> Duration {
+    start.map(|s| s.elapsed()).unwrap_or(Duration::ZERO)
+}
+
+#[cfg(target_arch = "wasm32")]
+fn method_clock_elapsed(_start: Option<()>) -> Duration {
+    Duration::ZERO
+}
+
+/// Compresses `data` in independent blocks of `block_size` bytes each.
+///
+/// The blocks are compressed in parallel on all available cores, each
+/// running the given list of `CompressionMethods` like `compress` does.
+/// The output is a framed container that records the block size, the
+/// original data length and the compressed length of every block, so
+/// the decoder side can walk and decode blocks independently (see
+/// `BlockDecoder`).
+///
+/// The returned reports contain one entry per compression method with
+/// the sizes summed over all blocks. A method is reported as skipped
+/// only if it was skipped for every block.
+pub fn compress_blocked(data: &[u8], methods: &[CompressionMethods], block_size: usize) -> (Vec<u8>, Vec<CompressionReport>) {
+    assert!(block_size > 0);
+
+    let blocks: Vec<&[u8]> = data.chunks(block_size).collect();
+    let results: Mutex<Vec<Option<(Vec<u8>, Vec<CompressionReport>)>>> = Mutex::new(vec![None; blocks.len()]);
+    let next_block = AtomicUsize::new(0);
+    let num_workers = usize::min(
+        blocks.len(),
+        thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    );
+
+    thread::scope(|s| {
+        for _ in 0..num_workers {
+            s.spawn(|| loop {
+                let idx = next_block.fetch_add(1, atomic::Ordering::Relaxed);
+                if idx >= blocks.len() {
+                    break;
+                }
+                let res = compress(blocks[idx], methods);
+                results.lock().unwrap()[idx] = Some(res);
+            });
+        }
+    });
+
+    let results: Vec<(Vec<u8>, Vec<CompressionReport>)> = results.into_inner().unwrap()
+        .into_iter()
+        .map(Option::unwrap)
+        .collect();
+
+    let mut header = BitVec::new();
+    encode_fibonacci_into(block_size, &mut header);
+    encode_fibonacci_into(data.len(), &mut header);
+    for (block, _) in &results {
+        encode_fibonacci_into(block.len(), &mut header);
+    }
+    let mut out = header.to_bytes();
+    for (block, _) in &results {
+        out.extend_from_slice(block);
+    }
+
+    let reports = methods.iter()
+        .enumerate()
+        .map(|(i, method)| CompressionReport {
+            method: *method,
+            input_size: results.iter().map(|(_, reports)| reports[i].input_size).sum(),
+            compressed_size: results.iter().map(|(_, reports)| reports[i].compressed_size).sum(),
+            skipped: results.iter().all(|(_, reports)| reports[i].skipped),
+            time: results.iter().map(|(_, reports)| reports[i].time).sum(),
+            stats: results.iter()
+                .map(|(_, reports)| reports[i].stats)
+                .reduce(|a, b| a.merge(&b))
+                .unwrap_or(MethodStats::None)
+        })
+        .collect();
+
+    (out, reports)
+}
+
+/// Decoder side of the framed container written by `compress_blocked`.
+///
+/// The container header is parsed eagerly; the individual blocks are
+/// decoded on demand, which allows partial as well as parallel decoding.
+pub struct BlockDecoder<'a> {
+    data: &'a [u8],
+    block_size: usize,
+    total_len: usize,
+    blocks: Vec<(usize, usize)>
+}
+
+impl<'a> BlockDecoder<'a> {
+    pub fn new<'b>(data: &'b [u8]) -> BlockDecoder<'b> {
+        let mut header = RawSliceDecoder::new(data);
+        let block_size = decode_fibonacci(&mut header);
+        let total_len = decode_fibonacci(&mut header);
+        let block_count = (total_len + block_size - 1) / block_size;
+        let lens: Vec<usize> = (0..block_count).map(|_| decode_fibonacci(&mut header)).collect();
+
+        // Blocks start at the next byte boundary after the header.
+        let mut offset = (header.bit_position() + 7) / 8;
+        let mut blocks = Vec::with_capacity(block_count);
+        for len in lens {
+            blocks.push((offset, len));
+            offset += len;
+        }
+
+        BlockDecoder {
+            data,
+            block_size,
+            total_len,
+            blocks
+        }
+    }
+
+    pub fn block_count(&self) -> usize {
+        self.blocks.len()
+    }
+
+    /// Length of the decoded contents of the given block. All blocks
+    /// except the last have the container's full block size.
+    pub fn block_len(&self, idx: usize) -> usize {
+        usize::min(self.total_len - idx * self.block_size, self.block_size)
+    }
+
+    /// Total length of the original data.
+    pub fn total_len(&self) -> usize {
+        self.total_len
+    }
+
+    /// Decodes the given block into `out`, which should be
+    /// `block_len(idx)` bytes long.
+    pub fn decode_block(&self, idx: usize, out: &mut [u8]) {
+        let (offset, len) = self.blocks[idx];
+        let mut decoder = make_decoder(&self.data[offset..offset + len]);
+        decoder.decode_bytes(out);
     }
-    (bits_to_data(&out), reports)
 }
 
 /// Creates a `Decoder` for the compressed data.
 ///
 /// Note that no checks are made to ensure that the data is in a valid format.
 /// If the data was not created by `compress`, or if it is corrupted
-/// in any way, this function will likely panic. Furthermore, the returned
-/// `Decoder` does not know the original length of the data. Reading past the
-/// end of the original data will likely also panic.
+/// in any way, this function will likely panic. Reading past the end of
+/// the original data will likely also panic; use
+/// `make_decoder_with_length` to know where the meaningful data ends.
 #[no_mangle]
 pub fn make_decoder<'a>(data: &'a [u8]) -> Box<dyn Decoder + 'a> {
+    make_decoder_with_length(data).0
+}
+
+/// Like `make_decoder`, but also returns the length of the original
+/// data, which `compress` records in the stream.
+pub fn make_decoder_with_length<'a>(data: &'a [u8]) -> (Box<dyn Decoder + 'a>, usize) {
     let mut decoder: Box<dyn Decoder + 'a> = Box::new(RawSliceDecoder::new(data));
     loop {
         let method = decode_fibonacci(decoder.as_mut());
         match method {
-            #[cfg(feature = "lz77")] 1 => decoder = Box::new(LZ77Decoder::new(decoder)),
+            #[cfg(feature = "lz77")] 1 => {
+                let window_exp = decode_fibonacci(decoder.as_mut()) as u8;
+                decoder = match window_exp {
+                    LZ77_WINDOW_SMALL => Box::new(LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(decoder)),
+                    LZ77_WINDOW_LARGE => Box::new(LZ77Decoder::<_, WINDOW_BYTES_LARGE>::new(decoder)),
+                    _ => panic!("Unsupported LZ77 window size")
+                };
+            },
             #[cfg(feature = "rc")] 2 => decoder = Box::new(RCDecoder::new(decoder)),
-            _ => return decoder,
+            _ => {
+                let length = decode_fibonacci(decoder.as_mut());
+                return (decoder, length);
+            }
         }
     }
 }
 
+/// Pull-based chunked consumer over a decoder stack.
+///
+/// The asset is decoded into a fixed internal buffer one chunk at a
+/// time, so data larger than free RAM can be processed with bounded
+/// memory. The reader knows the total length from the stream's length
+/// header and never decodes past the end.
+pub struct ChunkReader<'a> {
+    decoder: Box<dyn Decoder + 'a>,
+    remaining: usize,
+    buffer: Vec<u8>
+}
+
+impl<'a> ChunkReader<'a> {
+    /// Creates a reader over the compressed data, decoding `chunk_size`
+    /// bytes at a time.
+    pub fn new<'b>(data: &'b [u8], chunk_size: usize) -> ChunkReader<'b> {
+        assert!(chunk_size > 0);
+        let (decoder, length) = make_decoder_with_length(data);
+        ChunkReader {
+            decoder,
+            remaining: length,
+            buffer: vec![0; chunk_size]
+        }
+    }
+
+    /// Number of bytes that have not been decoded yet.
+    pub fn remaining(&self) -> usize {
+        self.remaining
+    }
+
+    /// Decodes and returns the next chunk, or `None` once the whole
+    /// stream has been consumed. Every chunk except the last has the
+    /// configured chunk size.
+    pub fn next_chunk(&mut self) -> Option<&[u8]> {
+        if self.remaining == 0 {
+            return None;
+        }
+        let len = usize::min(self.remaining, self.buffer.len());
+        self.decoder.decode_bytes(&mut self.buffer[..len]);
+        self.remaining -= len;
+        Some(&self.buffer[..len])
+    }
+}
+
+/// A statically-composed decoder stack.
+///
+/// The method chains chosen by `compressed!` are known at build time and
+/// cover a small set of legal stacks, so they can be monomorphized:
+/// every decoded bit goes through a single match instead of a chain of
+/// virtual calls that cannot be inlined. Construct with
+/// `make_decoder_static`; streams with deeper nesting still need the
+/// dynamic `make_decoder`.
+pub enum StaticDecoder<'a> {
+    Raw(RawSliceDecoder<'a>),
+    #[cfg(feature = "lz77")]
+    Lz77Small(LZ77Decoder<RawSliceDecoder<'a>, WINDOW_BYTES_SMALL>),
+    #[cfg(feature = "lz77")]
+    Lz77Large(LZ77Decoder<RawSliceDecoder<'a>, WINDOW_BYTES_LARGE>),
+    #[cfg(feature = "rc")]
+    Rc(RCDecoder<RawSliceDecoder<'a>>),
+    #[cfg(all(feature = "lz77", feature = "rc"))]
+    Lz77SmallRc(LZ77Decoder<RCDecoder<RawSliceDecoder<'a>>, WINDOW_BYTES_SMALL>),
+    #[cfg(all(feature = "lz77", feature = "rc"))]
+    Lz77LargeRc(LZ77Decoder<RCDecoder<RawSliceDecoder<'a>>, WINDOW_BYTES_LARGE>),
+    #[cfg(all(feature = "lz77", feature = "rc"))]
+    RcLz77Small(RCDecoder<LZ77Decoder<RawSliceDecoder<'a>, WINDOW_BYTES_SMALL>>),
+    #[cfg(all(feature = "lz77", feature = "rc"))]
+    RcLz77Large(RCDecoder<LZ77Decoder<RawSliceDecoder<'a>, WINDOW_BYTES_LARGE>>)
+}
+
+impl<'a> Decoder for StaticDecoder<'a> {
+    fn decode_bit(&mut self) -> bool {
+        match self {
+            StaticDecoder::Raw(d) => d.decode_bit(),
+            #[cfg(feature = "lz77")] StaticDecoder::Lz77Small(d) => d.decode_bit(),
+            #[cfg(feature = "lz77")] StaticDecoder::Lz77Large(d) => d.decode_bit(),
+            #[cfg(feature = "rc")] StaticDecoder::Rc(d) => d.decode_bit(),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::Lz77SmallRc(d) => d.decode_bit(),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::Lz77LargeRc(d) => d.decode_bit(),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::RcLz77Small(d) => d.decode_bit(),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::RcLz77Large(d) => d.decode_bit()
+        }
+    }
+
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        match self {
+            StaticDecoder::Raw(d) => d.decode_bytes(out),
+            #[cfg(feature = "lz77")] StaticDecoder::Lz77Small(d) => d.decode_bytes(out),
+            #[cfg(feature = "lz77")] StaticDecoder::Lz77Large(d) => d.decode_bytes(out),
+            #[cfg(feature = "rc")] StaticDecoder::Rc(d) => d.decode_bytes(out),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::Lz77SmallRc(d) => d.decode_bytes(out),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::Lz77LargeRc(d) => d.decode_bytes(out),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::RcLz77Small(d) => d.decode_bytes(out),
+            #[cfg(all(feature = "lz77", feature = "rc"))] StaticDecoder::RcLz77Large(d) => d.decode_bytes(out)
+        }
+    }
+}
+
+/// Creates a fully monomorphized `StaticDecoder` for the compressed data.
+///
+/// Like `make_decoder`, no checks are made that the data is valid.
+/// Panics for stacks not covered by `StaticDecoder`, i.e. anything with
+/// more than two compression layers.
+pub fn make_decoder_static<'a>(data: &'a [u8]) -> StaticDecoder<'a> {
+    make_decoder_static_with_length(data).0
+}
+
+/// Like `make_decoder_static`, but also returns the length of the
+/// original data recorded in the stream.
+pub fn make_decoder_static_with_length<'a>(data: &'a [u8]) -> (StaticDecoder<'a>, usize) {
+    let mut decoder = build_static_decoder(data);
+    let length = decode_fibonacci(&mut decoder);
+    (decoder, length)
+}
+
+fn build_static_decoder<'a>(data: &'a [u8]) -> StaticDecoder<'a> {
+    let mut raw = RawSliceDecoder::new(data);
+    match decode_fibonacci(&mut raw) {
+        #[cfg(feature = "lz77")] 1 => {
+            let window_exp = decode_fibonacci(&mut raw) as u8;
+            match window_exp {
+                LZ77_WINDOW_SMALL => {
+                    let mut lz77 = LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(raw);
+                    match decode_fibonacci(&mut lz77) {
+                        #[cfg(feature = "rc")] 2 => {
+                            let mut rc = RCDecoder::new(lz77);
+                            match decode_fibonacci(&mut rc) {
+                                1 | 2 => panic!("Decoder stack too deep for StaticDecoder"),
+                                _ => StaticDecoder::RcLz77Small(rc)
+                            }
+                        },
+                        1 => panic!("Decoder stack too deep for StaticDecoder"),
+                        _ => StaticDecoder::Lz77Small(lz77)
+                    }
+                },
+                LZ77_WINDOW_LARGE => {
+                    let mut lz77 = LZ77Decoder::<_, WINDOW_BYTES_LARGE>::new(raw);
+                    match decode_fibonacci(&mut lz77) {
+                        #[cfg(feature = "rc")] 2 => {
+                            let mut rc = RCDecoder::new(lz77);
+                            match decode_fibonacci(&mut rc) {
+                                1 | 2 => panic!("Decoder stack too deep for StaticDecoder"),
+                                _ => StaticDecoder::RcLz77Large(rc)
+                            }
+                        },
+                        1 => panic!("Decoder stack too deep for StaticDecoder"),
+                        _ => StaticDecoder::Lz77Large(lz77)
+                    }
+                },
+                _ => panic!("Unsupported LZ77 window size")
+            }
+        },
+        #[cfg(feature = "rc")] 2 => {
+            let mut rc = RCDecoder::new(raw);
+            match decode_fibonacci(&mut rc) {
+                #[cfg(feature = "lz77")] 1 => {
+                    let window_exp = decode_fibonacci(&mut rc) as u8;
+                    match window_exp {
+                        LZ77_WINDOW_SMALL => {
+                            let mut lz77 = LZ77Decoder::<_, WINDOW_BYTES_SMALL>::new(rc);
+                            match decode_fibonacci(&mut lz77) {
+                                1 | 2 => panic!("Decoder stack too deep for StaticDecoder"),
+                                _ => StaticDecoder::Lz77SmallRc(lz77)
+                            }
+                        },
+                        LZ77_WINDOW_LARGE => {
+                            let mut lz77 = LZ77Decoder::<_, WINDOW_BYTES_LARGE>::new(rc);
+                            match decode_fibonacci(&mut lz77) {
+                                1 | 2 => panic!("Decoder stack too deep for StaticDecoder"),
+                                _ => StaticDecoder::Lz77LargeRc(lz77)
+                            }
+                        },
+                        _ => panic!("Unsupported LZ77 window size")
+                    }
+                },
+                2 => panic!("Decoder stack too deep for StaticDecoder"),
+                _ => StaticDecoder::Rc(rc)
+            }
+        },
+        _ => StaticDecoder::Raw(raw)
+    }
+}
+
 #[cfg(test)]
 extern crate quickcheck;
 
@@ -180,12 +667,71 @@ mod tests {
 
     use std::{cmp::Ordering, iter::repeat_with};
 
-    use crate::{compress, decode_symbol, make_decoder, CompressionMethods};
+    use crate::{compress, compress_blocked, decode_symbol, make_decoder, make_decoder_static, make_decoder_static_with_length, BlockDecoder, ChunkReader, CompressionMethods, Decoder, RawSliceDecoder};
 
     use super::quickcheck::{
         quickcheck, TestResult
     };
 
+    #[test]
+    fn test_decode_bytes_raw() {
+        let data: &[u8] = &[0x12, 0x34, 0x56, 0x78, 0x9a];
+
+        // Byte-aligned reads are plain copies.
+        let mut decoder = RawSliceDecoder::new(data);
+        let mut out = [0; 3];
+        decoder.decode_bytes(&mut out);
+        assert_eq!(out, [0x12, 0x34, 0x56]);
+
+        // Unaligned reads combine two input bytes each and pad with
+        // 0-bits past the end of the input.
+        let mut decoder = RawSliceDecoder::new(data);
+        for _ in 0..4 {
+            decoder.decode_bit();
+        }
+        let mut out = [0; 5];
+        decoder.decode_bytes(&mut out);
+        assert_eq!(out, [0x23, 0x45, 0x67, 0x89, 0xa0]);
+    }
+
+    #[test]
+    fn test_chunked_decode() {
+        let data: Vec<u8> = (0..2000_u32).map(|i| ((i / 3) % 100) as u8).collect();
+        let (encoded, _) = compress(&data, &[CompressionMethods::LZ77 { window_exp: crate::LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }]);
+
+        let (_, length) = make_decoder_static_with_length(&encoded);
+        assert_eq!(length, data.len());
+
+        let mut reader = ChunkReader::new(&encoded, 256);
+        let mut decoded = Vec::new();
+        while let Some(chunk) = reader.next_chunk() {
+            assert!(chunk.len() == 256 || decoded.len() + chunk.len() == data.len());
+            decoded.extend_from_slice(chunk);
+        }
+        assert_eq!(decoded, data);
+        assert_eq!(reader.remaining(), 0);
+    }
+
+    #[test]
+    fn test_cursor() {
+        // More than 64 KB, so the cursor has to be wider than u16.
+        let data: Vec<u8> = (0..100_000_u32).map(|i| (i % 251) as u8).collect();
+
+        let mut decoder = RawSliceDecoder::new(&data);
+        decoder.seek(90_000 * 8);
+        assert_eq!(decoder.bit_position(), 90_000 * 8);
+        let mut out = [0; 4];
+        decoder.decode_bytes(&mut out);
+        assert_eq!(out, [(90_000 % 251) as u8, (90_001 % 251) as u8, (90_002 % 251) as u8, (90_003 % 251) as u8]);
+
+        decoder.skip_bits(12);
+        assert_eq!(decoder.bit_position(), 90_004 * 8 + 12);
+
+        decoder.reset();
+        assert_eq!(decoder.bit_position(), 0);
+        assert_eq!(decoder.decode_bit(), false);
+    }
+
     quickcheck! {
         fn encoded_data_can_be_decoded(data: Vec<u8>) -> TestResult {
             let expanded_data: Vec<u8> = data.chunks_exact(2)
@@ -197,11 +743,50 @@ mod tests {
                 return TestResult::discard();
             }
 
-            let (encoded, _) = compress(&expanded_data, &[CompressionMethods::LZ77, CompressionMethods::RC]);
+            let (encoded, _) = compress(&expanded_data, &[CompressionMethods::LZ77 { window_exp: crate::LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }]);
 
             let mut decoder = make_decoder(&encoded);
             let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(decoder.as_mut())).take(expanded_data.len()).collect();
-            TestResult::from_bool(decoded.cmp(&expanded_data) == Ordering::Equal)
+            if decoded.cmp(&expanded_data) != Ordering::Equal {
+                return TestResult::failed();
+            }
+
+            // The static decoder must accept the same streams and produce
+            // the same output as the boxed chain.
+            let mut decoder = make_decoder_static(&encoded);
+            let mut decoded = vec![0; expanded_data.len()];
+            decoder.decode_bytes(&mut decoded);
+            TestResult::from_bool(decoded == expanded_data)
+        }
+
+        fn blocked_data_can_be_decoded(data: Vec<u8>) -> TestResult {
+            let expanded_data: Vec<u8> = data.chunks_exact(2)
+                .flat_map(|d| {
+                    std::iter::repeat(d[1]).take(d[0] as usize)
+                })
+                .collect();
+            if expanded_data.len() <= 0 {
+                return TestResult::discard();
+            }
+
+            let methods = [CompressionMethods::LZ77 { window_exp: crate::LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }];
+            let (encoded, reports) = compress_blocked(&expanded_data, &methods, 256);
+            if reports.len() != methods.len() {
+                return TestResult::failed();
+            }
+
+            let block_decoder = BlockDecoder::new(&encoded);
+            if block_decoder.total_len() != expanded_data.len() {
+                return TestResult::failed();
+            }
+            let mut decoded = vec![0; expanded_data.len()];
+            for (idx, chunk) in decoded.chunks_mut(256).enumerate() {
+                if block_decoder.block_len(idx) != chunk.len() {
+                    return TestResult::failed();
+                }
+                block_decoder.decode_block(idx, chunk);
+            }
+            TestResult::from_bool(decoded == expanded_data)
         }
     }
 }
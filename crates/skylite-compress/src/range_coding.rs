@@ -1,144 +1,226 @@
 use crate::bit_prediction::BitPredictor;
+use crate::bitstream::BitVec;
 use crate::decode_symbol;
-use crate::symbol_to_bits;
 use crate::Decoder;
 use crate::bit_prediction;
-
-fn emit_code(start: u64, width: u64) -> (bool, u64, u64) {
-    let code = (start & 0x8000_0000) != 0;
-    let start_masked = start & 0x7fff_ffff;
-
-    // If start and start + width to not share the same leading nibble,
-    // either start or width has to be adjusted so that the leading
-    // nibble is the same for both ends of the range.
-    let discrepancy = 0x8000_0000 - start_masked;
-    if discrepancy < width / 2 {
-        // Adjust range from the bottom
-        (true, 0, (width - discrepancy) << 1)
-    } else if discrepancy < width {
-        // Adjust range from the top
-        (false, start_masked << 1, discrepancy << 1)
+use crate::MethodStats;
+
+/// Lower bound of the range before renormalization. As long as the range
+/// is at least this large, the top byte of `low` is settled and can be
+/// moved to the output.
+const RANGE_BOTTOM: u32 = 1 << 24;
+
+/// Starting probability for the adaptive model.
+const INITIAL_PROBABILITY: u32 = 0x8000;
+
+/// Adaptation rate of the adaptive model; smaller values adapt faster.
+const ADAPTATION_SHIFT: u32 = 5;
+
+/// Moves the adaptive 0-probability towards the observed bit. The
+/// encoder and the decoder must apply this identically after every
+/// coded bit. The probability can never reach 0 or 0xffff, so the
+/// coder cannot collapse the range.
+fn adapt(probability_0: u32, bit: bool) -> u32 {
+    if bit {
+        probability_0 - (probability_0 >> ADAPTATION_SHIFT)
     } else {
-        // Keep range as-is
-        (code, start_masked << 1, width << 1)
+        probability_0 + ((0xffff - probability_0) >> ADAPTATION_SHIFT)
+    }
+}
+
+/// Carry-counting range encoder that renormalizes a byte at a time.
+///
+/// All range updates are multiplications and shifts; there are no
+/// divisions anywhere in the coder, which matters on targets that have
+/// to emulate 64-bit division (wasm32). Settled bytes are pushed onto
+/// the output as 8-bit groups. A finished stream always starts with a
+/// 0-byte from the initial cache, which the decoder skips.
+struct RangeEncoder<'a> {
+    out: &'a mut BitVec,
+    low: u64,
+    range: u32,
+    cache: u8,
+    cache_size: u64,
+    renormalizations: usize
+}
+
+impl<'a> RangeEncoder<'a> {
+    fn new(out: &'a mut BitVec) -> RangeEncoder<'a> {
+        RangeEncoder {
+            out,
+            low: 0,
+            range: u32::MAX,
+            cache: 0,
+            cache_size: 1,
+            renormalizations: 0
+        }
+    }
+
+    fn shift_low(&mut self) {
+        if self.low < 0xff00_0000 || self.low > 0xffff_ffff {
+            // The carry out of the top byte is settled now, so the cached
+            // byte and any run of 0xff bytes behind it can be emitted.
+            let carry = (self.low >> 32) as u8;
+            self.out.push_bits(self.cache.wrapping_add(carry) as u64, 8);
+            for _ in 1..self.cache_size {
+                self.out.push_bits(0xff_u8.wrapping_add(carry) as u64, 8);
+            }
+            self.cache = (self.low >> 24) as u8;
+            self.cache_size = 0;
+        }
+        self.cache_size += 1;
+        self.low = (self.low << 8) & 0xffff_ffff;
+    }
+
+    /// Encodes one bit with the given 16-bit probability for a 0-bit.
+    fn encode_bit(&mut self, probability_0: u32, bit: bool) {
+        let bound = (self.range >> 16) * probability_0;
+        if bit {
+            self.low += bound as u64;
+            self.range -= bound;
+        } else {
+            self.range = bound;
+        }
+
+        while self.range < RANGE_BOTTOM {
+            self.shift_low();
+            self.range <<= 8;
+            self.renormalizations += 1;
+        }
+    }
+
+    fn finish(mut self) -> usize {
+        // Flush the remaining 32 bits of low plus the cached byte.
+        for _ in 0..5 {
+            self.shift_low();
+        }
+        self.renormalizations + 5
     }
 }
 
 /// Encode `data` using range coding.
-pub fn encode_rc<'a>(data: &[bool]) -> Vec<bool> {
+///
+/// With `adaptive` set, the probability model starts from a neutral
+/// state and adapts after every bit, mirrored exactly by the decoder;
+/// this encodes in a single pass and follows drifting bit statistics.
+/// Otherwise a counting pass computes one static probability for the
+/// whole stream, which is recorded in the header. The chosen mode is
+/// recorded as the first bit of the stream.
+pub fn encode_rc(data: &BitVec, out: &mut BitVec, adaptive: bool) -> MethodStats {
     assert!(data.len() > 0);
 
     // Start by applying bit prediction to reduce the number of 1-bits.
     let (predicted, taps) = bit_prediction::encode(data);
 
-    let zeros_count: u64 = predicted.iter().filter(|b| !**b).count() as u64;
-    let probability_0: u64 = if zeros_count > 0 {
-        // The probability must not get rounded to 0 when there are actually 0s to
-        // encode, otherwise the encoder will get stuck in an infinite loop when
-        // encountering a 0.
-        u64::max((zeros_count * 0xffff_ffff / predicted.len() as u64) & 0xffff_0000, 1)
+    out.push(adaptive);
+    out.push_bits(taps as u64, 16);
+
+    let probability_0: u32 = if adaptive {
+        INITIAL_PROBABILITY
     } else {
-        // If there really are no 0s to encode, a probability of 0 is ok
-        // because the branch which would cause problems will never be
-        // taken.
-        0
+        let zeros_count = (predicted.len() - predicted.count_ones()) as u64;
+        let probability_0 = if zeros_count > 0 {
+            // The probability must not get rounded to 0 when there are
+            // actually 0s to encode, otherwise the encoder would collapse
+            // the range to zero width when encountering a 0.
+            u64::max(zeros_count * 0xffff / predicted.len() as u64, 1) as u32
+        } else {
+            // If there really are no 0s to encode, a probability of 0 is ok
+            // because the branch which would cause problems will never be
+            // taken.
+            0
+        };
+        out.push_bits(probability_0 as u64, 16);
+        probability_0
     };
-    let mut out: Vec<bool> = Vec::new();
-
-    out.append(&mut symbol_to_bits(((probability_0 >> 16) & 0xffff) as u16));
-    out.append(&mut symbol_to_bits(taps));
 
-    let mut start: u64 = 0;
-    let mut width: u64 = 0x1_0000_0000;
-
-    for bit in predicted {
-        if bit {
-            start += width * probability_0 / 0x1_0000_0000;
-            width = width * (0x1_0000_0000 - probability_0) / 0x1_0000_0000;
-        } else {
-            width = width * probability_0 / 0x1_0000_0000;
+    let mut encoder = RangeEncoder::new(out);
+    if adaptive {
+        let mut probability_0 = probability_0;
+        for bit in predicted.iter() {
+            encoder.encode_bit(probability_0, bit);
+            probability_0 = adapt(probability_0, bit);
         }
-
-        while (start >> 31) == (start + width >> 31) || width <= 0xffff {
-            let bit: bool;
-            (bit, start, width) = emit_code(start, width);
-            out.push(bit);
+    } else {
+        for bit in predicted.iter() {
+            encoder.encode_bit(probability_0, bit);
         }
     }
+    let renormalizations = encoder.finish();
 
-    while width < 0x1_0000_0000 {
-        let bit: bool;
-        (bit, start, width) = emit_code(start, width);
-        out.push(bit);
-    }
-
-    out
+    MethodStats::Rc { renormalizations }
 }
 
 /// Decoder state for range coding.
-pub struct RCDecoder<'a> {
-    source: Box<dyn Decoder + 'a>,
-    probability_0: u64,
+pub struct RCDecoder<S: Decoder> {
+    source: S,
+    probability_0: u32,
+    adaptive: bool,
     predictor: bit_prediction::BitPredictor,
-    start: u64,
-    width: u64,
-    x: u64
+    range: u32,
+    code: u32
 }
 
-impl<'a> RCDecoder<'a> {
+impl<S: Decoder> RCDecoder<S> {
+
+    pub fn new(mut source: S) -> RCDecoder<S> {
+        let adaptive = source.decode_bit();
+        let taps = decode_symbol::<u16>(&mut source);
+        let probability = if adaptive {
+            INITIAL_PROBABILITY
+        } else {
+            decode_symbol::<u16>(&mut source) as u32
+        };
 
-    pub fn new<'b>(mut source: Box<dyn Decoder + 'b>) -> RCDecoder<'b> {
-        let probability = decode_symbol::<u16>(source.as_mut()) as u64;
-        let taps = decode_symbol::<u16>(source.as_mut());
-        let x = decode_symbol::<u32>(source.as_mut()) as u64;
+        // The first byte is the encoder's initial zero cache byte; the
+        // following four bytes are the initial code value.
+        let mut init = [0; 5];
+        source.decode_bytes(&mut init);
+        let code = u32::from_be_bytes(init[1..5].try_into().unwrap());
 
         RCDecoder {
             source,
-            probability_0: probability << 16,
+            probability_0: probability,
+            adaptive,
             predictor: BitPredictor::new(taps),
-            start: 0,
-            width: 0x1_0000_0000,
-            x
+            range: u32::MAX,
+            code
         }
     }
+}
 
-    fn adjust_range(&mut self) {
-        let start_masked = self.start & 0x7fff_ffff;
-        let discrepancy = 0x8000_0000 - start_masked;
-
-        if discrepancy < self.width / 2 {
-            // Adjust range from the bottom
-            self.start = 0;
-            self.width = (self.width - discrepancy) << 1;
-        } else if discrepancy < self.width {
-            // Adjust range from the top
-            self.start = start_masked << 1;
-            self.width = discrepancy << 1;
-        } else {
-            // Keep range as-is
-            self.start = start_masked << 1;
-            self.width <<= 1;
-        }
+/// One step of the range decoder: splits the range at the probability
+/// bound and consumes renormalization bytes from `source`. Returns the
+/// coded (post-prediction-stream) bit. Shared between the bitwise and
+/// the batched decode paths, which differ only in where the state
+/// lives.
+fn decode_step(source: &mut impl Decoder, range: &mut u32, code: &mut u32, probability_0: u32) -> bool {
+    let bound = (*range >> 16) * probability_0;
+    let decoded_bit = *code >= bound;
+    if decoded_bit {
+        *code -= bound;
+        *range -= bound;
+    } else {
+        *range = bound;
+    }
 
-        self.x = (self.x & 0x7fff_ffff) << 1;
-        self.x |= self.source.decode_bit() as u64;
+    while *range < RANGE_BOTTOM {
+        let mut byte = [0; 1];
+        source.decode_bytes(&mut byte);
+        *code = (*code << 8) | byte[0] as u32;
+        *range <<= 8;
     }
+
+    decoded_bit
 }
 
-impl<'a> Decoder for RCDecoder<'a> {
+impl<S: Decoder> Decoder for RCDecoder<S> {
 
     fn decode_bit(&mut self) -> bool {
-        let threshold = self.x - self.start;
-        let decoded_bit = self.probability_0 * self.width / 0x1_0000_0000 <= threshold;
-        if decoded_bit {
-            self.start += self.width * self.probability_0 / 0x1_0000_0000;
-            self.width = self.width * (0x1_0000_0000 - self.probability_0) / 0x1_0000_0000;
-        } else {
-            self.width = self.width * self.probability_0 / 0x1_0000_0000;
-        }
+        let decoded_bit = decode_step(&mut self.source, &mut self.range, &mut self.code, self.probability_0);
 
-        while (self.start >> 31) == (self.start + self.width >> 31) || self.width <= 0xffff {
-            self.adjust_range();
+        if self.adaptive {
+            self.probability_0 = adapt(self.probability_0, decoded_bit);
         }
 
         let predicted = self.predictor.predict();
@@ -147,6 +229,42 @@ impl<'a> Decoder for RCDecoder<'a> {
 
         bit
     }
+
+    fn decode_bytes(&mut self, out: &mut [u8]) {
+        // The exact flooring arithmetic of the range updates has to be
+        // replicated bit by bit, so the multiplies cannot be widened.
+        // What can be batched is the state handling: the whole coder
+        // state lives in locals for the duration of the run, so the
+        // compiler keeps it in registers instead of re-loading the
+        // fields for every bit like the decode_bit path does. Source
+        // bytes are only touched during renormalization.
+        let mut range = self.range;
+        let mut code = self.code;
+        let mut probability_0 = self.probability_0;
+        let mut predictor = self.predictor;
+
+        for b in out.iter_mut() {
+            let mut v = 0;
+            for _ in 0..8 {
+                let decoded_bit = decode_step(&mut self.source, &mut range, &mut code, probability_0);
+
+                if self.adaptive {
+                    probability_0 = adapt(probability_0, decoded_bit);
+                }
+
+                let predicted = predictor.predict();
+                let bit = predicted != decoded_bit;
+                predictor.push_bit(bit);
+                v = (v << 1) | bit as u8;
+            }
+            *b = v;
+        }
+
+        self.range = range;
+        self.code = code;
+        self.probability_0 = probability_0;
+        self.predictor = predictor;
+    }
 }
 
 #[cfg(test)]
@@ -160,7 +278,7 @@ mod tests {
         quickcheck, TestResult
     };
 
-    use crate::{bits_to_data, data_to_bits, decode_symbol, encode_rc, range_coding::RCDecoder, RawSliceDecoder};
+    use crate::{bitstream::BitVec, decode_symbol, encode_rc, range_coding::RCDecoder, RawSliceDecoder};
 
     #[test]
     fn test_compression() {
@@ -174,27 +292,30 @@ mod tests {
             })
             .collect();
 
-        let encoded = bits_to_data(&encode_rc(&data_to_bits(&data)));
-        let expectation = &[
-            236, 127, 0, 8,
-            100, 50, 84, 208,
-            187, 206, 247, 3,
-            221, 191, 37, 156,
-            207, 192, 209, 198,
-            49, 167, 196, 196,
-            83, 121, 124, 242,
-            13, 26, 114, 207,
-            135, 94, 138, 176,
-            229, 25, 193, 95,
-            156, 206, 53, 119,
-            152, 109, 2, 59,
-            222, 234, 212, 250,
-            197, 220
+        let mut bits = BitVec::new();
+        encode_rc(&BitVec::from_bytes(&data), &mut bits, false);
+        let encoded = bits.to_bytes();
+        let expectation: &[u8] = &[
+            0, 4, 118, 63,
+            128, 50, 20, 135,
+            130, 22, 154, 92,
+            120, 68, 203, 42,
+            110, 206, 255, 152,
+            211, 126, 141, 149,
+            119, 147, 32, 156,
+            96, 14, 50, 82,
+            226, 115, 244, 133,
+            98, 22, 32, 35,
+            213, 2, 114, 177,
+            141, 218, 233, 158,
+            204, 101, 74, 74,
+            91, 113, 16, 26,
+            42, 125, 128
         ];
 
         assert_eq!(&encoded[..], expectation);
 
-        let mut decoder = RCDecoder::new(Box::new(RawSliceDecoder::new(&encoded)));
+        let mut decoder = RCDecoder::new(RawSliceDecoder::new(&encoded));
         let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(data.len()).collect();
         assert_eq!(decoded[..], data);
     }
@@ -210,9 +331,19 @@ mod tests {
                 return TestResult::discard();
             }
 
-            let encoded = bits_to_data(&encode_rc(&data_to_bits(&expanded_data)));
+            let mut bits = BitVec::new();
+            encode_rc(&BitVec::from_bytes(&expanded_data), &mut bits, false);
+            let encoded = bits.to_bytes();
+            let mut decoder = RCDecoder::new(RawSliceDecoder::new(&encoded));
+            let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(expanded_data.len()).collect();
+            if decoded != expanded_data {
+                return TestResult::failed();
+            }
 
-            let mut decoder = RCDecoder::new(Box::new(RawSliceDecoder::new(&encoded)));
+            let mut bits = BitVec::new();
+            encode_rc(&BitVec::from_bytes(&expanded_data), &mut bits, true);
+            let encoded = bits.to_bytes();
+            let mut decoder = RCDecoder::new(RawSliceDecoder::new(&encoded));
             let decoded: Vec<u8> = repeat_with(|| decode_symbol::<u8>(&mut decoder)).take(expanded_data.len()).collect();
             TestResult::from_bool(decoded == expanded_data)
         }
@@ -0,0 +1,113 @@
+use skylite_compress::{make_decoder_static_with_length, Decoder};
+
+/// Byte-budgeted LRU cache of decompressed assets.
+///
+/// Scenes tend to reference the same compressed assets repeatedly, and
+/// decoding an asset is far more expensive than looking it up. The cache
+/// keeps decoded assets up to a fixed byte budget (sized for the target's
+/// RAM) and hands out slices of already-decompressed data; a decoder is
+/// only spun up on a miss. The least recently used assets are evicted
+/// when the budget is exceeded, though the most recent asset is always
+/// kept, even if it alone exceeds the budget.
+pub struct DecodedAssetCache {
+    budget: usize,
+    used: usize,
+    // Ordered by recency, most recently used at the back.
+    entries: Vec<(u16, Vec<u8>)>
+}
+
+impl DecodedAssetCache {
+    pub fn new(budget: usize) -> DecodedAssetCache {
+        DecodedAssetCache {
+            budget,
+            used: 0,
+            entries: Vec::new()
+        }
+    }
+
+    /// Returns the decoded contents of the asset identified by `id`,
+    /// decoding `compressed` only if the asset is not cached. The
+    /// decoded length comes from the length header of the stream.
+    pub fn get_or_decode(&mut self, id: u16, compressed: &[u8]) -> &[u8] {
+        if let Some(idx) = self.entries.iter().position(|(entry_id, _)| *entry_id == id) {
+            let entry = self.entries.remove(idx);
+            self.entries.push(entry);
+            return &self.entries.last().unwrap().1;
+        }
+
+        let (mut decoder, decoded_len) = make_decoder_static_with_length(compressed);
+        let mut decoded = vec![0; decoded_len];
+        decoder.decode_bytes(&mut decoded);
+        self.used += decoded.len();
+        self.entries.push((id, decoded));
+
+        while self.used > self.budget && self.entries.len() > 1 {
+            let (_, evicted) = self.entries.remove(0);
+            self.used -= evicted.len();
+        }
+
+        &self.entries.last().unwrap().1
+    }
+
+    /// Like `get_or_decode`, counting the decoded bytes of a miss in
+    /// the frame profiler. Compiles down to a plain `get_or_decode`
+    /// when instrumentation is disabled.
+    pub fn get_or_decode_profiled(&mut self, id: u16, compressed: &[u8], profiler: &mut crate::instrumentation::FrameProfiler) -> &[u8] {
+        let miss = !self.entries.iter().any(|(entry_id, _)| *entry_id == id);
+        let decoded = self.get_or_decode(id, compressed);
+        if miss {
+            profiler.count_bytes_decoded(decoded.len());
+        }
+        decoded
+    }
+
+    /// Number of decoded bytes currently held.
+    pub fn used_bytes(&self) -> usize {
+        self.used
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use skylite_compress::{compress, CompressionMethods, LZ77_WINDOW_SMALL};
+
+    use super::DecodedAssetCache;
+
+    fn make_asset(seed: u8, len: usize) -> (Vec<u8>, Vec<u8>) {
+        let data: Vec<u8> = (0..len).map(|i| seed.wrapping_add((i / 7) as u8)).collect();
+        let (encoded, _) = compress(&data, &[CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }]);
+        (data, encoded)
+    }
+
+    #[test]
+    fn test_hits_and_eviction() {
+        let (data_a, encoded_a) = make_asset(1, 1000);
+        let (data_b, encoded_b) = make_asset(2, 1000);
+        let (data_c, encoded_c) = make_asset(3, 1000);
+
+        let mut cache = DecodedAssetCache::new(2048);
+        assert_eq!(cache.get_or_decode(0, &encoded_a), &data_a[..]);
+        assert_eq!(cache.get_or_decode(1, &encoded_b), &data_b[..]);
+        assert_eq!(cache.used_bytes(), 2000);
+
+        // A touches its entry, so B is the least recently used when C
+        // forces an eviction.
+        assert_eq!(cache.get_or_decode(0, &encoded_a), &data_a[..]);
+        assert_eq!(cache.get_or_decode(2, &encoded_c), &data_c[..]);
+        assert_eq!(cache.used_bytes(), 2000);
+        assert!(cache.entries.iter().any(|(id, _)| *id == 0));
+        assert!(!cache.entries.iter().any(|(id, _)| *id == 1));
+    }
+
+    #[test]
+    fn test_oversized_asset_is_kept() {
+        let (data, encoded) = make_asset(7, 4000);
+        let mut cache = DecodedAssetCache::new(1024);
+        assert_eq!(cache.get_or_decode(0, &encoded), &data[..]);
+        assert_eq!(cache.used_bytes(), 4000);
+        // The next asset evicts the oversized one.
+        let (data_b, encoded_b) = make_asset(8, 500);
+        assert_eq!(cache.get_or_decode(1, &encoded_b), &data_b[..]);
+        assert_eq!(cache.used_bytes(), 500);
+    }
+}
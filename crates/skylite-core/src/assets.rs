@@ -0,0 +1,92 @@
+use skylite_compress::{make_decoder_static_with_length, StaticDecoder};
+
+use crate::asset_cache::DecodedAssetCache;
+
+/// Gives the runtime access to asset bytes as borrowed regions.
+///
+/// Backends expose their asset storage directly - a memory-mapped file,
+/// a flash XIP window, a segment of wasm linear memory - instead of
+/// copying assets into heap first. The returned slices borrow from the
+/// store, and the decoder stack decodes compressed assets straight out
+/// of that memory.
+pub trait AssetStore {
+    /// Returns the raw (usually compressed) bytes of the given asset.
+    fn asset_bytes(&self, id: u16) -> &[u8];
+}
+
+/// Creates a decoder that reads the given asset directly out of the
+/// store's memory, together with the decoded length recorded in the
+/// stream. The decoder borrows the mapping for as long as it lives; no
+/// copy of the compressed data is made.
+pub fn asset_decoder<'a>(store: &'a impl AssetStore, id: u16) -> (StaticDecoder<'a>, usize) {
+    make_decoder_static_with_length(store.asset_bytes(id))
+}
+
+impl DecodedAssetCache {
+    /// Like `get_or_decode`, with the compressed bytes taken straight
+    /// from the given store.
+    pub fn get_from_store(&mut self, store: &impl AssetStore, id: u16) -> &[u8] {
+        self.get_or_decode(id, store.asset_bytes(id))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use skylite_compress::{compress, CompressionMethods, Decoder, LZ77_WINDOW_SMALL};
+
+    use crate::asset_cache::DecodedAssetCache;
+
+    use super::{asset_decoder, AssetStore};
+
+    /// Store over a single contiguous region, the shape of a cartridge
+    /// mapping: one slice, assets at fixed offsets.
+    struct MappedStore {
+        data: Vec<u8>,
+        assets: Vec<(usize, usize)>
+    }
+
+    impl AssetStore for MappedStore {
+        fn asset_bytes(&self, id: u16) -> &[u8] {
+            let (offset, len) = self.assets[id as usize];
+            &self.data[offset..offset + len]
+        }
+    }
+
+    fn make_store() -> (MappedStore, Vec<Vec<u8>>) {
+        let mut store = MappedStore {
+            data: Vec::new(),
+            assets: Vec::new()
+        };
+        let mut originals = Vec::new();
+        for seed in 0..3_u8 {
+            let original: Vec<u8> = (0..800).map(|i| seed.wrapping_add((i / 5) as u8)).collect();
+            let (encoded, _) = compress(&original, &[CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }]);
+            store.assets.push((store.data.len(), encoded.len()));
+            store.data.extend_from_slice(&encoded);
+            originals.push(original);
+        }
+        (store, originals)
+    }
+
+    #[test]
+    fn test_decode_from_store() {
+        let (store, originals) = make_store();
+
+        let (mut decoder, decoded_len) = asset_decoder(&store, 1);
+        assert_eq!(decoded_len, originals[1].len());
+        let mut decoded = vec![0; decoded_len];
+        decoder.decode_bytes(&mut decoded);
+        assert_eq!(decoded, originals[1]);
+    }
+
+    #[test]
+    fn test_cache_from_store() {
+        let (store, originals) = make_store();
+        let mut cache = DecodedAssetCache::new(4096);
+
+        assert_eq!(cache.get_from_store(&store, 0), &originals[0][..]);
+        assert_eq!(cache.get_from_store(&store, 2), &originals[2][..]);
+        assert_eq!(cache.get_from_store(&store, 0), &originals[0][..]);
+        assert_eq!(cache.used_bytes(), 1600);
+    }
+}
@@ -0,0 +1,175 @@
+use crate::{DrawCmd, SkyliteTarget};
+
+/// A screen-space rectangle in pixels.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct Rect {
+    pub x: i16,
+    pub y: i16,
+    pub w: u16,
+    pub h: u16
+}
+
+impl Rect {
+    fn right(&self) -> i16 {
+        self.x + self.w as i16
+    }
+
+    fn bottom(&self) -> i16 {
+        self.y + self.h as i16
+    }
+
+    /// Whether the two rectangles overlap or share an edge.
+    fn touches(&self, other: &Rect) -> bool {
+        self.x <= other.right() && other.x <= self.right()
+            && self.y <= other.bottom() && other.y <= self.bottom()
+    }
+
+    fn union(&self, other: &Rect) -> Rect {
+        let x = i16::min(self.x, other.x);
+        let y = i16::min(self.y, other.y);
+        Rect {
+            x,
+            y,
+            w: (i16::max(self.right(), other.right()) - x) as u16,
+            h: (i16::max(self.bottom(), other.bottom()) - y) as u16
+        }
+    }
+}
+
+/// Records which screen rectangles were touched during a frame.
+///
+/// Drawing already funnels through the `SkyliteTarget` draw interface,
+/// so the regions a frame changed are known exactly. A target can
+/// restrict its present/flush to these rectangles, which on displays
+/// that are updated line by line is most of the frame time in
+/// mostly-static scenes.
+pub struct DirtyTracker {
+    screen_w: u16,
+    screen_h: u16,
+    rects: Vec<Rect>
+}
+
+impl DirtyTracker {
+    pub fn new(screen_w: u16, screen_h: u16) -> DirtyTracker {
+        DirtyTracker {
+            screen_w,
+            screen_h,
+            rects: Vec::new()
+        }
+    }
+
+    /// Marks the screen area touched by a draw command. Rotation swaps
+    /// the on-screen width and height; flips do not change the footprint.
+    pub fn mark_draw(&mut self, cmd: &DrawCmd) {
+        let (w, h) = if cmd.rotate {
+            (cmd.src_h, cmd.src_w)
+        } else {
+            (cmd.src_w, cmd.src_h)
+        };
+        self.mark(Rect { x: cmd.x, y: cmd.y, w, h });
+    }
+
+    /// Marks an arbitrary screen rectangle as dirty. The rectangle is
+    /// clipped to the screen; fully off-screen rectangles are ignored.
+    pub fn mark(&mut self, rect: Rect) {
+        // Clipped in i32, since the right/bottom edge of a far off-screen
+        // rectangle can exceed the i16 range.
+        let x = i32::max(rect.x as i32, 0);
+        let y = i32::max(rect.y as i32, 0);
+        let right = i32::min(rect.x as i32 + rect.w as i32, self.screen_w as i32);
+        let bottom = i32::min(rect.y as i32 + rect.h as i32, self.screen_h as i32);
+        if x >= right || y >= bottom {
+            return;
+        }
+        let mut rect = Rect { x: x as i16, y: y as i16, w: (right - x) as u16, h: (bottom - y) as u16 };
+
+        // Keep the list small by folding the new rectangle into any
+        // rectangle it overlaps or touches. The union can make further
+        // merges possible, so merging repeats until nothing combines.
+        loop {
+            let merged = self.rects.iter().position(|r| r.touches(&rect));
+            match merged {
+                Some(idx) => rect = self.rects.swap_remove(idx).union(&rect),
+                None => break
+            }
+        }
+        self.rects.push(rect);
+    }
+
+    /// The rectangles touched since the last `clear`.
+    pub fn rects(&self) -> &[Rect] {
+        &self.rects
+    }
+
+    /// Ends the frame: hands the tracked rectangles to the target's
+    /// `present` and resets the tracker.
+    pub fn present(&mut self, target: &mut impl SkyliteTarget) {
+        target.present(&self.rects);
+        self.rects.clear();
+    }
+
+    /// Resets the tracker for the next frame.
+    pub fn clear(&mut self) {
+        self.rects.clear();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{DrawCmd, SkyliteTarget};
+
+    use super::{DirtyTracker, Rect};
+
+    fn cmd(x: i16, y: i16, w: u16, h: u16, rotate: bool) -> DrawCmd {
+        DrawCmd {
+            x,
+            y,
+            src_x: 0,
+            src_y: 0,
+            src_w: w,
+            src_h: h,
+            flip_h: false,
+            flip_v: false,
+            rotate
+        }
+    }
+
+    #[test]
+    fn test_mark_draws() {
+        let mut tracker = DirtyTracker::new(128, 160);
+        tracker.mark_draw(&cmd(10, 20, 8, 16, false));
+        assert_eq!(tracker.rects(), &[Rect { x: 10, y: 20, w: 8, h: 16 }]);
+
+        // Rotation swaps the on-screen footprint.
+        tracker.clear();
+        tracker.mark_draw(&cmd(10, 20, 8, 16, true));
+        assert_eq!(tracker.rects(), &[Rect { x: 10, y: 20, w: 16, h: 8 }]);
+    }
+
+    #[test]
+    fn test_clipping() {
+        let mut tracker = DirtyTracker::new(128, 160);
+        tracker.mark_draw(&cmd(-4, 156, 8, 8, false));
+        assert_eq!(tracker.rects(), &[Rect { x: 0, y: 156, w: 4, h: 4 }]);
+
+        tracker.clear();
+        tracker.mark_draw(&cmd(200, 0, 8, 8, false));
+        assert!(tracker.rects().is_empty());
+    }
+
+    #[test]
+    fn test_merging() {
+        let mut tracker = DirtyTracker::new(128, 160);
+        tracker.mark_draw(&cmd(0, 0, 8, 8, false));
+        tracker.mark_draw(&cmd(100, 100, 8, 8, false));
+        tracker.mark_draw(&cmd(8, 0, 8, 8, false));
+        assert_eq!(tracker.rects().len(), 2);
+        assert!(tracker.rects().contains(&Rect { x: 0, y: 0, w: 16, h: 8 }));
+        assert!(tracker.rects().contains(&Rect { x: 100, y: 100, w: 8, h: 8 }));
+
+        // A rectangle bridging the two remaining ones collapses the
+        // list to a single union.
+        tracker.mark_draw(&cmd(0, 0, 110, 110, false));
+        assert_eq!(tracker.rects(), &[Rect { x: 0, y: 0, w: 110, h: 110 }]);
+    }
+}
@@ -0,0 +1,160 @@
+use std::time::Duration;
+
+/// Number of past frames kept for post-hoc inspection.
+pub const FRAME_HISTORY: usize = 64;
+
+/// Statistics accumulated over one frame.
+#[derive(Clone, Copy, Default, Debug, PartialEq)]
+pub struct FrameStats {
+    /// Number of draw batches submitted to the target.
+    pub draw_calls: u32,
+    /// Total number of draw commands across all batches.
+    pub draw_commands: u32,
+    /// Bytes of assets decoded (cache misses only).
+    pub bytes_decoded: u32,
+    /// Time spent driving saves on the frame loop.
+    pub save_stall: Duration
+}
+
+// Instant is unimplemented on wasm32-unknown-unknown; spans report zero
+// there.
+#[cfg(all(feature = "instrumentation", not(target_arch = "wasm32")))]
+fn clock() -> Option<std::time::Instant> {
+    Some(std::time::Instant::now())
+}
+
+#[cfg(all(feature = "instrumentation", target_arch = "wasm32"))]
+fn clock() -> Option<()> {
+    None
+}
+
+/// Collects per-frame counters and timing spans from the hot paths.
+///
+/// Only compiled in with the `instrumentation` feature; without it,
+/// this is a zero-sized type whose methods are empty and the
+/// `*_profiled` call sites compile down to their unprofiled form.
+/// A ring of the most recent frames is kept so a spike can be
+/// inspected after the fact.
+#[cfg(feature = "instrumentation")]
+pub struct FrameProfiler {
+    current: FrameStats,
+    history: [FrameStats; FRAME_HISTORY],
+    frames: usize
+}
+
+#[cfg(feature = "instrumentation")]
+impl FrameProfiler {
+    pub fn new() -> FrameProfiler {
+        FrameProfiler {
+            current: FrameStats::default(),
+            history: [FrameStats::default(); FRAME_HISTORY],
+            frames: 0
+        }
+    }
+
+    pub fn count_draw_batch(&mut self, commands: usize) {
+        self.current.draw_calls += 1;
+        self.current.draw_commands += commands as u32;
+    }
+
+    pub fn count_bytes_decoded(&mut self, bytes: usize) {
+        self.current.bytes_decoded += bytes as u32;
+    }
+
+    /// Runs `work` and adds its wall time to the frame's save stall.
+    pub fn time_save<R>(&mut self, work: impl FnOnce() -> R) -> R {
+        let start = clock();
+        let out = work();
+        self.current.save_stall += start.map(|s| s.elapsed()).unwrap_or(Duration::ZERO);
+        out
+    }
+
+    /// Closes the current frame: its statistics are recorded in the
+    /// history ring and returned, and the counters reset.
+    pub fn end_frame(&mut self) -> FrameStats {
+        let stats = self.current;
+        self.history[self.frames % FRAME_HISTORY] = stats;
+        self.frames += 1;
+        self.current = FrameStats::default();
+        stats
+    }
+
+    /// The recorded frames, most recent first, up to `FRAME_HISTORY`.
+    pub fn recent_frames(&self) -> impl Iterator<Item = FrameStats> + '_ {
+        (0..usize::min(self.frames, FRAME_HISTORY))
+            .map(move |i| self.history[(self.frames - 1 - i) % FRAME_HISTORY])
+    }
+}
+
+#[cfg(not(feature = "instrumentation"))]
+pub struct FrameProfiler;
+
+#[cfg(not(feature = "instrumentation"))]
+impl FrameProfiler {
+    pub fn new() -> FrameProfiler {
+        FrameProfiler
+    }
+
+    pub fn count_draw_batch(&mut self, _commands: usize) {}
+
+    pub fn count_bytes_decoded(&mut self, _bytes: usize) {}
+
+    pub fn time_save<R>(&mut self, work: impl FnOnce() -> R) -> R {
+        work()
+    }
+
+    pub fn end_frame(&mut self) -> FrameStats {
+        FrameStats::default()
+    }
+
+    pub fn recent_frames(&self) -> impl Iterator<Item = FrameStats> + '_ {
+        std::iter::empty()
+    }
+}
+
+#[cfg(all(test, feature = "instrumentation"))]
+mod tests {
+    use super::{FrameProfiler, FRAME_HISTORY};
+
+    #[test]
+    fn test_frame_ring() {
+        let mut profiler = FrameProfiler::new();
+
+        profiler.count_draw_batch(10);
+        profiler.count_draw_batch(5);
+        profiler.count_bytes_decoded(4096);
+        let stats = profiler.end_frame();
+        assert_eq!(stats.draw_calls, 2);
+        assert_eq!(stats.draw_commands, 15);
+        assert_eq!(stats.bytes_decoded, 4096);
+
+        // Counters reset per frame, and history is most recent first.
+        profiler.count_draw_batch(1);
+        profiler.end_frame();
+        let recent: Vec<_> = profiler.recent_frames().collect();
+        assert_eq!(recent.len(), 2);
+        assert_eq!(recent[0].draw_commands, 1);
+        assert_eq!(recent[1].draw_commands, 15);
+
+        // The ring holds at most FRAME_HISTORY frames and keeps the
+        // newest ones.
+        for i in 0..FRAME_HISTORY as u32 + 10 {
+            profiler.count_bytes_decoded(i as usize);
+            profiler.end_frame();
+        }
+        let recent: Vec<_> = profiler.recent_frames().collect();
+        assert_eq!(recent.len(), FRAME_HISTORY);
+        assert_eq!(recent[0].bytes_decoded, FRAME_HISTORY as u32 + 9);
+    }
+
+    #[test]
+    fn test_save_span() {
+        let mut profiler = FrameProfiler::new();
+        let out = profiler.time_save(|| {
+            std::thread::sleep(std::time::Duration::from_millis(2));
+            7
+        });
+        assert_eq!(out, 7);
+        assert!(profiler.end_frame().save_stall >= std::time::Duration::from_millis(2));
+    }
+}
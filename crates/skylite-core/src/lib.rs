@@ -1,16 +1,51 @@
+pub mod asset_cache;
+pub mod assets;
+pub mod blit;
+pub mod dirty;
+pub mod instrumentation;
 #[cfg(test)]
 mod mock;
+pub mod save;
+
+/// Identifies a texture atlas previously registered with a target via
+/// `SkyliteTarget::register_atlas`. Handles are cheap to copy and pass
+/// per draw call; the target keeps whatever decoded or uploaded form of
+/// the atlas it needs resident.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct AtlasHandle(pub u16);
+
+/// A single draw operation within a texture atlas, with the same
+/// parameters and semantics as `SkyliteTarget::draw_sub`, minus the
+/// atlas data itself.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct DrawCmd {
+    pub x: i16,
+    pub y: i16,
+    pub src_x: i16,
+    pub src_y: i16,
+    pub src_w: u16,
+    pub src_h: u16,
+    pub flip_h: bool,
+    pub flip_v: bool,
+    pub rotate: bool
+}
 
 /// Defines which functions a backend must provide to work with Skylite.
-trait SkyliteTarget {
+pub trait SkyliteTarget {
     /// Creates a new instance of the target.
     fn new() -> Self;
 
-    /// Draws a region from a texture atlas to the screen.
+    /// Registers a texture atlas with the target and returns a handle for
+    /// use in draw calls.
     ///
-    /// The texture atlas is given as the `data` parameter. There is no fixed format for the data,
-    /// so it is up to the implementation to interpret the remaining parameters apropriately. The data
-    /// will always be the complete content of a single graphics file.
+    /// There is no fixed format for the data, so it is up to the
+    /// implementation to interpret it appropriately. The data will always
+    /// be the complete content of a single graphics file. This is called
+    /// once per graphics asset at load time, so the target can decode or
+    /// upload the atlas here instead of re-interpreting it on every draw.
+    fn register_atlas(&mut self, data: &[u8]) -> AtlasHandle;
+
+    /// Draws a region from a registered texture atlas to the screen.
     ///
     /// The position where the region should be drawn on the screen is given by the `x` and `y` parameters,
     /// with (0, 0) being the top-left corner.
@@ -21,7 +56,20 @@ trait SkyliteTarget {
     /// If `flip_h` is true, the region should be mirrored horizontally before drawing. If `flip_v` is true,
     /// the region should be flipped vertically. If `rotate` is true, the region should be rotated 90 degrees
     /// clockwise. Rotation is applied after flipping.
-    fn draw_sub(&mut self, data: &[u8], x: i16, y: i16, src_x: i16, src_y: i16, src_w: u16, src_h: u16, flip_h: bool, flip_v: bool, rotate: bool);
+    fn draw_sub(&mut self, atlas: AtlasHandle, x: i16, y: i16, src_x: i16, src_y: i16, src_w: u16, src_h: u16, flip_h: bool, flip_v: bool, rotate: bool);
+
+    /// Draws a whole list of regions from a single registered texture
+    /// atlas.
+    ///
+    /// The atlas is named once for the entire batch, so backends can bind
+    /// its resident form a single time and then process the commands in
+    /// one pass. The default implementation simply issues one `draw_sub`
+    /// call per command.
+    fn draw_batch(&mut self, atlas: AtlasHandle, commands: &[DrawCmd]) {
+        for cmd in commands {
+            self.draw_sub(atlas, cmd.x, cmd.y, cmd.src_x, cmd.src_y, cmd.src_w, cmd.src_h, cmd.flip_h, cmd.flip_v, cmd.rotate);
+        }
+    }
 
     /// Returns the screen size of the target as a (width, height) tuple.
     /// This must always return the same value during the lifetime of the instance.
@@ -34,4 +82,153 @@ trait SkyliteTarget {
 
     /// Loads data from the given location. `location` can be any arbitrary string.
     fn load_state(&self, location: &str) -> Vec<u8>;
+
+    /// Begins saving the given data without blocking, if the backend
+    /// supports it. `data` is only valid during this call; backends that
+    /// overlap the write with rendering (DMA, threaded IO) must move it
+    /// to their own storage here. Completion is reported through
+    /// `poll_save_complete`. The default implementation saves
+    /// synchronously.
+    fn save_state_async(&mut self, location: &str, data: &[u8]) {
+        self.save_state(location, data);
+    }
+
+    /// Returns whether the save started by the last `save_state_async`
+    /// call has finished. Backends whose writes complete within
+    /// `save_state_async` keep the default, which always reports
+    /// completion.
+    fn poll_save_complete(&mut self) -> bool {
+        true
+    }
+
+    /// Presents the frame to the display. `dirty` holds the screen
+    /// rectangles touched since the last present (see `DirtyTracker`);
+    /// targets whose displays are updated incrementally should restrict
+    /// their transfer to these areas. An empty slice means no tracked
+    /// drawing happened. The default does nothing, for targets that
+    /// present implicitly.
+    fn present(&mut self, _dirty: &[dirty::Rect]) {}
+}
+
+/// Display list of draw commands for a single texture atlas.
+///
+/// The commands for a frame are collected here and handed to the target
+/// in one `draw_batch` call, instead of making one trait call per drawn
+/// region.
+pub struct DrawQueue {
+    commands: Vec<DrawCmd>
+}
+
+impl DrawQueue {
+    pub fn new() -> DrawQueue {
+        DrawQueue {
+            commands: Vec::new()
+        }
+    }
+
+    pub fn push(&mut self, cmd: DrawCmd) {
+        self.commands.push(cmd);
+    }
+
+    /// Submits all queued commands to the target and clears the queue.
+    /// The queue keeps its allocation, so a queue that is reused across
+    /// frames stops allocating once it has reached its peak size.
+    pub fn flush(&mut self, target: &mut impl SkyliteTarget, atlas: AtlasHandle) {
+        target.draw_batch(atlas, &self.commands);
+        self.commands.clear();
+    }
+
+    /// Like `flush`, but also records the screen area touched by each
+    /// command in the given dirty tracker, so the target can restrict
+    /// its present to the changed regions.
+    pub fn flush_tracked(&mut self, target: &mut impl SkyliteTarget, atlas: AtlasHandle, tracker: &mut dirty::DirtyTracker) {
+        for cmd in &self.commands {
+            tracker.mark_draw(cmd);
+        }
+        self.flush(target, atlas);
+    }
+
+    /// Like `flush`, but counts the submission in the frame profiler.
+    /// Compiles down to a plain `flush` when instrumentation is
+    /// disabled.
+    pub fn flush_profiled(&mut self, target: &mut impl SkyliteTarget, atlas: AtlasHandle, profiler: &mut instrumentation::FrameProfiler) {
+        profiler.count_draw_batch(self.commands.len());
+        self.flush(target, atlas);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{dirty, mock::MockTarget, DrawCmd, DrawQueue, SkyliteTarget};
+
+    #[test]
+    fn test_draw_queue() {
+        let graphics_data: &[u8] = &[
+            0, 1, 2, 3,
+            4, 5, 6, 7,
+            8, 9, 10, 11,
+            12, 13, 14, 15,
+            4
+        ];
+
+        let mut queued = MockTarget::new();
+        let atlas = queued.register_atlas(graphics_data);
+        let mut queue = DrawQueue::new();
+        let mut tracker = dirty::DirtyTracker::new(128, 128);
+        queue.push(DrawCmd { x: 0, y: 0, src_x: 0, src_y: 0, src_w: 4, src_h: 4, flip_h: false, flip_v: false, rotate: false });
+        queue.push(DrawCmd { x: 4, y: 0, src_x: 0, src_y: 0, src_w: 4, src_h: 4, flip_h: true, flip_v: false, rotate: false });
+        queue.flush_tracked(&mut queued, atlas, &mut tracker);
+        assert!(queue.commands.is_empty());
+
+        // The two adjacent draws coalesce into one dirty rectangle,
+        // which ending the frame hands to the target's present.
+        assert_eq!(tracker.rects(), &[dirty::Rect { x: 0, y: 0, w: 8, h: 4 }]);
+        tracker.present(&mut queued);
+        assert_eq!(queued.call_history.last(), Some(&crate::mock::Call::Present { dirty: vec![dirty::Rect { x: 0, y: 0, w: 8, h: 4 }] }));
+        assert!(tracker.rects().is_empty());
+
+        // The default draw_batch impl must match individual draw_sub calls.
+        let mut direct = MockTarget::new();
+        let atlas = direct.register_atlas(graphics_data);
+        direct.draw_sub(atlas, 0, 0, 0, 0, 4, 4, false, false, false);
+        direct.draw_sub(atlas, 4, 0, 0, 0, 4, 4, true, false, false);
+
+        assert_eq!(queued.call_history[..2], direct.call_history[..]);
+        assert_eq!(queued.screen_buffer[..], direct.screen_buffer[..]);
+    }
+
+    #[cfg(feature = "instrumentation")]
+    #[test]
+    fn test_profiled_frame() {
+        use skylite_compress::{compress, CompressionMethods, LZ77_WINDOW_SMALL};
+
+        use crate::{asset_cache::DecodedAssetCache, instrumentation::FrameProfiler, save::SaveScheduler};
+
+        let graphics_data: &[u8] = &[0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 4];
+        let asset: Vec<u8> = (0..500).map(|i| (i / 3) as u8).collect();
+        let (encoded, _) = compress(&asset, &[CompressionMethods::LZ77 { window_exp: LZ77_WINDOW_SMALL, lazy: false }, CompressionMethods::RC { adaptive: true }]);
+
+        let mut target = MockTarget::new();
+        let atlas = target.register_atlas(graphics_data);
+        let mut profiler = FrameProfiler::new();
+        let mut queue = DrawQueue::new();
+        let mut cache = DecodedAssetCache::new(4096);
+        let mut saves = SaveScheduler::new("save0");
+
+        queue.push(DrawCmd { x: 0, y: 0, src_x: 0, src_y: 0, src_w: 4, src_h: 4, flip_h: false, flip_v: false, rotate: false });
+        queue.push(DrawCmd { x: 4, y: 0, src_x: 0, src_y: 0, src_w: 4, src_h: 4, flip_h: false, flip_v: false, rotate: false });
+        queue.flush_profiled(&mut target, atlas, &mut profiler);
+        cache.get_or_decode_profiled(0, &encoded, &mut profiler);
+        saves.request_save(&[1, 2, 3]);
+        saves.pump_profiled(&mut target, &mut profiler);
+
+        let stats = profiler.end_frame();
+        assert_eq!(stats.draw_calls, 1);
+        assert_eq!(stats.draw_commands, 2);
+        assert_eq!(stats.bytes_decoded, 500);
+
+        // A cache hit on the next frame does not count as decoding.
+        cache.get_or_decode_profiled(0, &encoded, &mut profiler);
+        assert_eq!(profiler.end_frame().bytes_decoded, 0);
+    }
 }
@@ -1,6 +1,6 @@
 use std::{collections::hash_map::DefaultHasher, hash::Hasher};
 
-use crate::SkyliteTarget;
+use crate::{blit::blit, dirty::Rect, AtlasHandle, SkyliteTarget};
 
 #[derive(Debug, PartialEq)]
 pub(crate) enum Call {
@@ -21,33 +21,19 @@ pub(crate) enum Call {
     SaveState {
         location: String,
         data: Vec<u8>
-    }
-}
-
-fn apply_transform(pos: (i16, i16), w: u16, h: u16, flip_h: bool, flip_v: bool, rotate: bool) -> (i16, i16) {
-    let pos = if flip_h {
-        (w as i16 - pos.0 - 1, pos.1)
-    } else {
-        pos
-    };
-
-    let pos = if flip_v {
-        (pos.0, h as i16 - pos.1 - 1)
-    } else {
-        pos
-    };
-
-    if rotate {
-        (h as i16 - pos.1 - 1, pos.0)
-    } else {
-        pos
+    },
+    Present {
+        dirty: Vec<Rect>
     }
 }
 
 pub(crate) struct MockTarget {
     pub(crate) call_history: Vec<Call>,
     pub(crate) screen_buffer: [u8; 128 * 128],
-    pub(crate) state: Vec<u8>
+    pub(crate) state: Vec<u8>,
+    // Registered atlases, with the data hash computed once at
+    // registration instead of once per draw call.
+    pub(crate) atlases: Vec<(u64, Vec<u8>)>
 }
 
 impl SkyliteTarget for MockTarget {
@@ -55,24 +41,30 @@ impl SkyliteTarget for MockTarget {
         MockTarget {
             call_history: Vec::new(),
             screen_buffer: [0; 128 * 128],
-            state: Vec::new()
+            state: Vec::new(),
+            atlases: Vec::new()
         }
     }
 
-    fn draw_sub(&mut self, data: &[u8], x: i16, y: i16, src_x: i16, src_y: i16, src_w: u16, src_h: u16, flip_h: bool, flip_v: bool, rotate: bool) {
+    fn register_atlas(&mut self, data: &[u8]) -> AtlasHandle {
         let mut hasher = DefaultHasher::new();
         hasher.write(data);
-        self.call_history.push(Call::DrawSub { data: hasher.finish(), x, y, src_x, src_y, src_w, src_h, flip_h, flip_v, rotate });
-
-        let data_width = data[data.len() - 1] as i16;
-        for offset_y in 0..src_h as i16 {
-            for offset_x in 0..src_w as i16 {
-                let src_index = (src_y + offset_y) * data_width + src_x + offset_x;
-                let screen_offset = apply_transform((offset_x, offset_y), src_w, src_h, flip_h, flip_v, rotate);
-                let screen_index = (y + screen_offset.1) * 128 + x + screen_offset.0;
-                self.screen_buffer[screen_index as usize] = data[src_index as usize];
-            }
-        }
+        self.atlases.push((hasher.finish(), data.to_owned()));
+        AtlasHandle((self.atlases.len() - 1) as u16)
+    }
+
+    fn draw_sub(&mut self, atlas: AtlasHandle, x: i16, y: i16, src_x: i16, src_y: i16, src_w: u16, src_h: u16, flip_h: bool, flip_v: bool, rotate: bool) {
+        let (hash, ref data) = self.atlases[atlas.0 as usize];
+        self.call_history.push(Call::DrawSub { data: hash, x, y, src_x, src_y, src_w, src_h, flip_h, flip_v, rotate });
+
+        // The last byte of the mock graphics format is the atlas width.
+        let data_width = data[data.len() - 1] as usize;
+        blit(
+            &data[..data.len() - 1], data_width, src_x as usize, src_y as usize,
+            &mut self.screen_buffer, 128, x as usize, y as usize,
+            src_w as usize, src_h as usize,
+            flip_h, flip_v, rotate
+        );
     }
 
     fn get_screen_size() -> (u16, u16) {
@@ -87,6 +79,10 @@ impl SkyliteTarget for MockTarget {
     fn load_state(&self, _location: &str) -> Vec<u8> {
         self.state.clone()
     }
+
+    fn present(&mut self, dirty: &[Rect]) {
+        self.call_history.push(Call::Present { dirty: dirty.to_owned() });
+    }
 }
 
 #[cfg(test)]
@@ -117,14 +113,15 @@ mod tests {
             hasher.finish()
         };
         let mut target = MockTarget::new();
-        target.draw_sub(graphics_data, 0, 0, 0, 0, 8, 8, false, false, false);
-        target.draw_sub(graphics_data, 8, 0, 0, 0, 8, 8, true, false, false);
-        target.draw_sub(graphics_data, 16, 0, 0, 0, 8, 8, false, true, false);
-        target.draw_sub(graphics_data, 24, 0, 0, 0, 8, 8, true, true, false);
-        target.draw_sub(graphics_data, 0, 8, 0, 0, 8, 8, false, false, true);
-        target.draw_sub(graphics_data, 8, 8, 0, 0, 8, 8, true, false, true);
-        target.draw_sub(graphics_data, 16, 8, 0, 0, 8, 8, false, true, true);
-        target.draw_sub(graphics_data, 24, 8, 0, 0, 8, 8, true, true, true);
+        let atlas = target.register_atlas(graphics_data);
+        target.draw_sub(atlas, 0, 0, 0, 0, 8, 8, false, false, false);
+        target.draw_sub(atlas, 8, 0, 0, 0, 8, 8, true, false, false);
+        target.draw_sub(atlas, 16, 0, 0, 0, 8, 8, false, true, false);
+        target.draw_sub(atlas, 24, 0, 0, 0, 8, 8, true, true, false);
+        target.draw_sub(atlas, 0, 8, 0, 0, 8, 8, false, false, true);
+        target.draw_sub(atlas, 8, 8, 0, 0, 8, 8, true, false, true);
+        target.draw_sub(atlas, 16, 8, 0, 0, 8, 8, false, true, true);
+        target.draw_sub(atlas, 24, 8, 0, 0, 8, 8, true, true, true);
 
         assert_eq!(target.call_history.len(), 8);
         assert_eq!(target.call_history[0], Call::DrawSub { data: graphics_data_hash, x: 0, y: 0, src_x: 0, src_y: 0, src_w: 8, src_h: 8, flip_h: false, flip_v: false, rotate: false });
@@ -0,0 +1,167 @@
+use crate::SkyliteTarget;
+
+/// Double-buffered, asynchronous save pipeline.
+///
+/// On targets where the backing store is slow (tens of milliseconds for
+/// a flash write), a synchronous `save_state` call drops frames. The
+/// scheduler instead snapshots the save data immediately into one of
+/// two reusable buffers and returns to the frame loop; `pump`, called
+/// once per frame, drains the snapshot to the target through
+/// `save_state_async` and tracks completion via `poll_save_complete`.
+///
+/// If a new save is requested while a write is still in flight, the
+/// snapshot waits in the pending buffer; requesting again before the
+/// write finishes replaces the pending snapshot, so the newest state
+/// wins and at most one write is ever queued behind the active one.
+pub struct SaveScheduler {
+    location: String,
+    pending: Option<Vec<u8>>,
+    writing: Option<Vec<u8>>,
+    spare: Vec<u8>
+}
+
+impl SaveScheduler {
+    pub fn new(location: &str) -> SaveScheduler {
+        SaveScheduler {
+            location: location.to_owned(),
+            pending: None,
+            writing: None,
+            spare: Vec::new()
+        }
+    }
+
+    /// Snapshots `data` for saving and returns immediately.
+    pub fn request_save(&mut self, data: &[u8]) {
+        let mut buffer = match self.pending.take() {
+            Some(buffer) => buffer,
+            None => std::mem::take(&mut self.spare)
+        };
+        buffer.clear();
+        buffer.extend_from_slice(data);
+        self.pending = Some(buffer);
+    }
+
+    /// Drives the pipeline. Call once per frame; each call costs at most
+    /// one completion poll and the start of one write.
+    pub fn pump(&mut self, target: &mut impl SkyliteTarget) {
+        if self.writing.is_some() {
+            if !target.poll_save_complete() {
+                return;
+            }
+            self.spare = self.writing.take().unwrap();
+        }
+
+        if let Some(buffer) = self.pending.take() {
+            target.save_state_async(&self.location, &buffer);
+            self.writing = Some(buffer);
+        }
+    }
+
+    /// Like `pump`, but accounts the time spent driving the target
+    /// against the frame's save stall. Compiles down to a plain `pump`
+    /// when instrumentation is disabled.
+    pub fn pump_profiled(&mut self, target: &mut impl SkyliteTarget, profiler: &mut crate::instrumentation::FrameProfiler) {
+        profiler.time_save(|| self.pump(target));
+    }
+
+    /// Whether all requested saves have been handed to the target and
+    /// completed. Consistency signal for shutdown: keep pumping until
+    /// this returns true.
+    pub fn is_idle(&self) -> bool {
+        self.pending.is_none() && self.writing.is_none()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{mock::MockTarget, AtlasHandle, SkyliteTarget};
+
+    use super::SaveScheduler;
+
+    #[test]
+    fn test_synchronous_target() {
+        let mut target = MockTarget::new();
+        let mut scheduler = SaveScheduler::new("save0");
+
+        let mut data = vec![1, 2, 3];
+        scheduler.request_save(&data);
+        // Mutations after the snapshot must not leak into the save.
+        data[0] = 99;
+        assert!(!scheduler.is_idle());
+
+        scheduler.pump(&mut target);
+        scheduler.pump(&mut target);
+        assert!(scheduler.is_idle());
+        assert_eq!(target.state, vec![1, 2, 3]);
+    }
+
+    /// Target whose saves only complete when the test says so.
+    struct SlowTarget {
+        inner: MockTarget,
+        complete: bool
+    }
+
+    impl SkyliteTarget for SlowTarget {
+        fn new() -> SlowTarget {
+            SlowTarget {
+                inner: MockTarget::new(),
+                complete: true
+            }
+        }
+
+        fn register_atlas(&mut self, data: &[u8]) -> AtlasHandle {
+            self.inner.register_atlas(data)
+        }
+
+        fn draw_sub(&mut self, atlas: AtlasHandle, x: i16, y: i16, src_x: i16, src_y: i16, src_w: u16, src_h: u16, flip_h: bool, flip_v: bool, rotate: bool) {
+            self.inner.draw_sub(atlas, x, y, src_x, src_y, src_w, src_h, flip_h, flip_v, rotate);
+        }
+
+        fn get_screen_size() -> (u16, u16) {
+            MockTarget::get_screen_size()
+        }
+
+        fn save_state(&mut self, location: &str, data: &[u8]) {
+            self.inner.save_state(location, data);
+        }
+
+        fn load_state(&self, location: &str) -> Vec<u8> {
+            self.inner.load_state(location)
+        }
+
+        fn save_state_async(&mut self, location: &str, data: &[u8]) {
+            self.inner.save_state(location, data);
+            self.complete = false;
+        }
+
+        fn poll_save_complete(&mut self) -> bool {
+            self.complete
+        }
+    }
+
+    #[test]
+    fn test_overlapping_requests() {
+        let mut target = SlowTarget::new();
+        let mut scheduler = SaveScheduler::new("save0");
+
+        scheduler.request_save(&[1]);
+        scheduler.pump(&mut target);
+        assert_eq!(target.inner.state, vec![1]);
+
+        // While the first write is in flight, newer requests coalesce;
+        // only the newest snapshot gets written once the device is done.
+        scheduler.request_save(&[2]);
+        scheduler.request_save(&[3]);
+        scheduler.pump(&mut target);
+        assert_eq!(target.inner.state, vec![1]);
+
+        target.complete = true;
+        scheduler.pump(&mut target);
+        assert_eq!(target.inner.state, vec![3]);
+        assert!(!scheduler.is_idle());
+
+        target.complete = true;
+        scheduler.pump(&mut target);
+        assert!(scheduler.is_idle());
+    }
+}
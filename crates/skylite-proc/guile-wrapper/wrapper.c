@@ -30,6 +30,48 @@ SCM (scm_from_bool)(bool obj) {
     return scm_from_bool(obj);
 }
 
+int64_t scm_list_length_wrapper(SCM obj) {
+    int64_t len = 0;
+    while (scm_is_pair(obj)) {
+        len++;
+        obj = scm_cdr(obj);
+    }
+    return scm_is_null(obj) ? len : -1;
+}
+
+int64_t scm_list_to_int64_array_wrapper(SCM obj, int64_t *out, int64_t max_len) {
+    int64_t count = 0;
+    while (scm_is_pair(obj) && count < max_len) {
+        SCM item = scm_car(obj);
+        // Checked with scm_is_signed_integer instead of converting
+        // blindly, because scm_to_int64 does a nonlocal exit on
+        // out-of-range values.
+        if (!scm_is_signed_integer(item, INT64_MIN, INT64_MAX)) {
+            return -1;
+        }
+        out[count++] = scm_to_int64(item);
+        obj = scm_cdr(obj);
+    }
+    if (count < max_len && !scm_is_null(obj)) {
+        return -1;
+    }
+    return count;
+}
+
+SCM scm_cxr_wrapper(SCM obj, const uint8_t *ops, int64_t count) {
+    for (int64_t i = 0; i < count; i++) {
+        if (!scm_is_pair(obj)) {
+            return SCM_UNDEFINED;
+        }
+        obj = ops[i] ? scm_cdr(obj) : scm_car(obj);
+    }
+    return obj;
+}
+
+bool scm_is_undefined_wrapper(SCM obj) {
+    return SCM_UNBNDP(obj);
+}
+
 void wrapper_free(void *ptr) {
     free(ptr);
 }
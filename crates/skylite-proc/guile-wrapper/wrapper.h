@@ -2,10 +2,27 @@
 
 #include <libguile.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 SCM scm_car_wrapper(SCM obj);
 SCM scm_cdr_wrapper(SCM obj);
 
+// Returns the length of obj if it is a proper list, or -1 otherwise,
+// in a single crossing.
+int64_t scm_list_length_wrapper(SCM obj);
+
+// Converts a proper list of exact integers into out (at most max_len
+// elements). Returns the number of elements written, or -1 if obj is
+// not a proper list of integers that fit into int64_t.
+int64_t scm_list_to_int64_array_wrapper(SCM obj, int64_t *out, int64_t max_len);
+
+// Applies count car/cdr operations in one call; ops[i] == 0 takes the
+// car, anything else the cdr. Returns SCM_UNDEFINED if a non-pair is
+// encountered along the way.
+SCM scm_cxr_wrapper(SCM obj, const uint8_t *ops, int64_t count);
+
+bool scm_is_undefined_wrapper(SCM obj);
+
 bool scm_is_true_wrapper(SCM obj);
 bool scm_is_false_wrapper(SCM obj);
 
@@ -16,4 +16,16 @@ extern "C" {
 
     #[link_name = "scm_is_false_wrapper"]
     pub fn scm_is_false(obj: SCM) -> bool;
+
+    #[link_name = "scm_list_length_wrapper"]
+    pub fn scm_list_length(obj: SCM) -> i64;
+
+    #[link_name = "scm_list_to_int64_array_wrapper"]
+    pub fn scm_list_to_int64_array(obj: SCM, out: *mut i64, max_len: i64) -> i64;
+
+    #[link_name = "scm_cxr_wrapper"]
+    pub fn scm_cxr(obj: SCM, ops: *const u8, count: i64) -> SCM;
+
+    #[link_name = "scm_is_undefined_wrapper"]
+    pub fn scm_is_undefined(obj: SCM) -> bool;
 }
@@ -1,10 +1,12 @@
-use std::{os::raw::c_void, ptr::null_mut, sync::{Mutex, MutexGuard}};
+use std::{os::raw::c_void, ptr::null_mut, sync::{atomic::{AtomicUsize, Ordering}, Mutex, MutexGuard}, thread};
 
 use guile::{scm_with_guile, SCM};
 
 mod guile;
+mod parse_cache;
 mod parse_util;
 mod project;
+mod save_layout;
 
 extern crate glob;
 
@@ -63,9 +65,82 @@ fn with_guile<P, R>(func: extern "C" fn(&P) -> R, params: P) -> R {
     }
 }
 
+struct PoolWorkerInfo<'a, P, R> {
+    func: extern "C" fn(&P) -> R,
+    params: &'a [P],
+    next_job: &'a AtomicUsize,
+    results: &'a Mutex<Vec<Option<R>>>,
+    guard: Option<MutexGuard<'static, ()>>
+}
+
+/// Runs `func` once for every element of `params` on a pool of
+/// Guile-enabled worker threads and returns the results in order.
+///
+/// Guile supports multiple threads, but registering a thread is not
+/// thread-safe, so each worker enters Guile mode while holding
+/// `guile_init_lock` and releases it once inside, like `with_guile`
+/// does. After that the workers drain the job queue concurrently.
+/// The nonlocal-exit caveats of `with_guile` apply to each job: a job
+/// that exits nonlocally takes its worker down, and the missing result
+/// turns into a panic here.
+fn with_guile_pool<P: Sync, R: Send>(func: extern "C" fn(&P) -> R, params: Vec<P>) -> Vec<R> {
+    unsafe extern "C" fn worker<P, R>(user_data: *mut c_void) -> *mut c_void {
+        let info = user_data as *mut PoolWorkerInfo<P, R>;
+        // Unlocks guile_init_lock
+        drop((*info).guard.take().unwrap());
+        let func = (*info).func;
+        let params = (*info).params;
+        let next_job = (*info).next_job;
+        let results = (*info).results;
+
+        loop {
+            let idx = next_job.fetch_add(1, Ordering::Relaxed);
+            if idx >= params.len() {
+                break;
+            }
+            // Guile might do a nonlocal return on this line, causing the
+            // result slot to stay empty.
+            let res = func(&params[idx]);
+            results.lock().unwrap()[idx] = Some(res);
+        }
+        null_mut()
+    }
+
+    let num_workers = usize::min(
+        params.len(),
+        thread::available_parallelism().map(|n| n.get()).unwrap_or(1)
+    );
+    let next_job = AtomicUsize::new(0);
+    let results: Mutex<Vec<Option<R>>> = Mutex::new((0..params.len()).map(|_| None).collect());
+
+    thread::scope(|s| {
+        for _ in 0..num_workers {
+            s.spawn(|| {
+                let guard = guile_init_lock.lock().unwrap();
+                let info = PoolWorkerInfo {
+                    func,
+                    params: &params,
+                    next_job: &next_job,
+                    results: &results,
+                    guard: Some(guard)
+                };
+                unsafe {
+                    scm_with_guile(Some(worker::<P, R>), &info as *const PoolWorkerInfo<P, R> as *mut c_void);
+                }
+            });
+        }
+    });
+
+    let results = results.into_inner().unwrap();
+    if results.iter().any(|res| res.is_none()) {
+        panic!("Nonlocal exit from Guile mode!");
+    }
+    results.into_iter().map(Option::unwrap).collect()
+}
+
 #[cfg(test)]
 mod tests {
-    use crate::{guile::{scm_car, scm_from_int16}, with_guile};
+    use crate::{guile::{scm_car, scm_from_int16, scm_from_int32, scm_to_int32}, with_guile, with_guile_pool};
 
 
     extern "C" fn guile_bad(_: &()) -> () {
@@ -79,4 +154,17 @@ mod tests {
     fn test_exception() {
         with_guile(guile_bad, ());
     }
+
+    extern "C" fn guile_double(value: &i32) -> i32 {
+        unsafe {
+            scm_to_int32(scm_from_int32(*value)) * 2
+        }
+    }
+
+    #[test]
+    fn test_guile_pool() {
+        let params: Vec<i32> = (0..64).collect();
+        let results = with_guile_pool(guile_double, params);
+        assert_eq!(results, (0..64).map(|v| v * 2).collect::<Vec<i32>>());
+    }
 }
@@ -0,0 +1,113 @@
+use std::{collections::hash_map::DefaultHasher, env, fs, hash::Hasher, path::PathBuf};
+
+/// Bumped whenever a serialized layout changes; entries with a
+/// different version are treated as cache misses.
+const CACHE_FORMAT_VERSION: u8 = 1;
+
+/// Serialization for parse results that are persisted across macro
+/// expansions. Deserialization returns `None` for data that does not
+/// match the expected layout, which turns corrupt cache entries into
+/// cache misses.
+pub(crate) trait CacheSerialize: Sized {
+    fn serialize(&self, out: &mut Vec<u8>);
+    fn deserialize(data: &mut &[u8]) -> Option<Self>;
+}
+
+pub(crate) fn write_usize(out: &mut Vec<u8>, value: usize) {
+    out.extend_from_slice(&(value as u64).to_le_bytes());
+}
+
+pub(crate) fn read_u8(data: &mut &[u8]) -> Option<u8> {
+    let (first, rest) = data.split_first()?;
+    *data = rest;
+    Some(*first)
+}
+
+pub(crate) fn read_bytes<'a>(data: &mut &'a [u8], len: usize) -> Option<&'a [u8]> {
+    if data.len() < len {
+        return None;
+    }
+    let (head, rest) = data.split_at(len);
+    *data = rest;
+    Some(head)
+}
+
+pub(crate) fn read_usize(data: &mut &[u8]) -> Option<usize> {
+    Some(u64::from_le_bytes(read_bytes(data, 8)?.try_into().unwrap()) as usize)
+}
+
+impl CacheSerialize for String {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        write_usize(out, self.len());
+        out.extend_from_slice(self.as_bytes());
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<String> {
+        let len = read_usize(data)?;
+        String::from_utf8(read_bytes(data, len)?.to_vec()).ok()
+    }
+}
+
+impl<T: CacheSerialize> CacheSerialize for Vec<T> {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        write_usize(out, self.len());
+        for item in self {
+            item.serialize(out);
+        }
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<Vec<T>> {
+        let len = read_usize(data)?;
+        let mut out = Vec::with_capacity(usize::min(len, 1024));
+        for _ in 0..len {
+            out.push(T::deserialize(data)?);
+        }
+        Some(out)
+    }
+}
+
+impl CacheSerialize for glob::Pattern {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        self.as_str().to_owned().serialize(out);
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<glob::Pattern> {
+        glob::Pattern::new(&String::deserialize(data)?).ok()
+    }
+}
+
+/// Location of the cache entry for the given source text, or `None` if
+/// caching is disabled. The key covers the full source content and the
+/// cached type, so an edited source file simply misses.
+fn cache_file<T>(source: &str) -> Option<PathBuf> {
+    let dir = env::var_os("SKYLITE_CACHE_DIR")?;
+    let mut hasher = DefaultHasher::new();
+    hasher.write(std::any::type_name::<T>().as_bytes());
+    hasher.write(source.as_bytes());
+    Some(PathBuf::from(dir).join(format!("skylite-parse-{:016x}.bin", hasher.finish())))
+}
+
+/// Loads the cached parse result for the given source text.
+pub(crate) fn load<T: CacheSerialize>(source: &str) -> Option<T> {
+    let bytes = fs::read(cache_file::<T>(source)?).ok()?;
+    let mut data = &bytes[..];
+    if read_u8(&mut data)? != CACHE_FORMAT_VERSION {
+        return None;
+    }
+    T::deserialize(&mut data)
+}
+
+/// Persists a parse result for the given source text. Failures are not
+/// reported; they only cost a re-parse on the next build.
+pub(crate) fn store<T: CacheSerialize>(source: &str, value: &T) {
+    let path = match cache_file::<T>(source) {
+        Some(path) => path,
+        None => return
+    };
+    let mut out = vec![CACHE_FORMAT_VERSION];
+    value.serialize(&mut out);
+    if let Some(parent) = path.parent() {
+        let _ = fs::create_dir_all(parent);
+    }
+    let _ = fs::write(path, out);
+}
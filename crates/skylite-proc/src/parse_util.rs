@@ -1,7 +1,8 @@
-use std::{ffi::{c_void, CStr, CString}, fmt::Display, ptr::null_mut};
+use std::{cell::Cell, ffi::{c_void, CStr, CString}, fmt::Display, path::Path, ptr::null_mut};
 
+use crate::parse_cache::{read_bytes, read_u8, CacheSerialize};
 use crate::{
-    guile::{scm_assq, scm_c_eval_string, scm_cadr, scm_car, scm_cdr, scm_from_utf8_symbol, scm_is_bool, scm_is_false, scm_is_integer, scm_is_null, scm_is_real, scm_is_symbol, scm_is_true, scm_length, scm_list_p, scm_object_to_string, scm_pair_p, scm_string_p, scm_symbol_to_string, scm_to_bool, scm_to_double, scm_to_int64, scm_to_utf8_stringn, wrapper_free, SCM}, SkyliteProcError
+    guile::{scm_assq, scm_c_eval_string, scm_c_lookup, scm_cadr, scm_call_1, scm_car, scm_cdr, scm_cxr, scm_from_utf8_string, scm_from_utf8_symbol, scm_is_bool, scm_is_false, scm_is_integer, scm_is_null, scm_is_real, scm_is_symbol, scm_is_true, scm_is_undefined, scm_list_length, scm_list_p, scm_list_to_int64_array, scm_object_to_string, scm_pair_p, scm_string_p, scm_symbol_to_string, scm_to_bool, scm_to_double, scm_to_int64, scm_to_utf8_stringn, scm_variable_ref, wrapper_free, SCM}, SkyliteProcError
 };
 
 
@@ -129,19 +130,20 @@ pub(crate) enum CXROp {
 
 use CXROp::*;
 
-/// Performs a sequence of CAR/CDR operations.
+/// Performs a sequence of CAR/CDR operations in a single FFI call.
 pub(crate) unsafe fn cxr(pair: SCM, ops: &[CXROp]) -> Result<SCM, SkyliteProcError> {
-    let mut cursor = pair;
-    for op in ops {
-        if scm_to_bool(scm_pair_p(cursor)) == 0 {
-            return Err(SkyliteProcError::DataError(format!("Not a pair, cannot do car/cdr: {}", form_to_string(cursor))));
-        }
-        match op {
-            CAR => cursor = scm_car(cursor),
-            CDR => cursor = scm_cdr(cursor),
-        }
+    debug_assert!(ops.len() <= 16);
+    let mut encoded = [0_u8; 16];
+    for (i, op) in ops.iter().enumerate() {
+        encoded[i] = matches!(op, CDR) as u8;
+    }
+
+    let res = scm_cxr(pair, encoded.as_ptr(), ops.len() as i64);
+    if scm_is_undefined(res) {
+        Err(SkyliteProcError::DataError(format!("Not a pair, cannot do car/cdr: {}", form_to_string(pair))))
+    } else {
+        Ok(res)
     }
-    Ok(cursor)
 }
 
 /// A data item combined with a type.
@@ -156,6 +158,48 @@ pub enum TypedValue {
     Vec(Vec<TypedValue>)
 }
 
+impl CacheSerialize for TypedValue {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        match self {
+            TypedValue::U8(v) => { out.push(0); out.push(*v); },
+            TypedValue::U16(v) => { out.push(1); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::U32(v) => { out.push(2); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::U64(v) => { out.push(3); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::I8(v) => { out.push(4); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::I16(v) => { out.push(5); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::I32(v) => { out.push(6); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::I64(v) => { out.push(7); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::F32(v) => { out.push(8); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::F64(v) => { out.push(9); out.extend_from_slice(&v.to_le_bytes()); },
+            TypedValue::Bool(v) => { out.push(10); out.push(*v as u8); },
+            TypedValue::String(v) => { out.push(11); v.serialize(out); },
+            TypedValue::Tuple(items) => { out.push(12); items.serialize(out); },
+            TypedValue::Vec(items) => { out.push(13); items.serialize(out); }
+        }
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<TypedValue> {
+        let out = match read_u8(data)? {
+            0 => TypedValue::U8(read_u8(data)?),
+            1 => TypedValue::U16(u16::from_le_bytes(read_bytes(data, 2)?.try_into().unwrap())),
+            2 => TypedValue::U32(u32::from_le_bytes(read_bytes(data, 4)?.try_into().unwrap())),
+            3 => TypedValue::U64(u64::from_le_bytes(read_bytes(data, 8)?.try_into().unwrap())),
+            4 => TypedValue::I8(i8::from_le_bytes(read_bytes(data, 1)?.try_into().unwrap())),
+            5 => TypedValue::I16(i16::from_le_bytes(read_bytes(data, 2)?.try_into().unwrap())),
+            6 => TypedValue::I32(i32::from_le_bytes(read_bytes(data, 4)?.try_into().unwrap())),
+            7 => TypedValue::I64(i64::from_le_bytes(read_bytes(data, 8)?.try_into().unwrap())),
+            8 => TypedValue::F32(f32::from_le_bytes(read_bytes(data, 4)?.try_into().unwrap())),
+            9 => TypedValue::F64(f64::from_le_bytes(read_bytes(data, 8)?.try_into().unwrap())),
+            10 => TypedValue::Bool(read_u8(data)? != 0),
+            11 => TypedValue::String(String::deserialize(data)?),
+            12 => TypedValue::Tuple(Vec::deserialize(data)?),
+            13 => TypedValue::Vec(Vec::deserialize(data)?),
+            _ => return None
+        };
+        Some(out)
+    }
+}
+
 /// Constructs a `TypedValue` given a Scheme form for the type and a form for the value.
 ///
 /// `item_type` must be one of the following symbols for primitive types:
@@ -202,10 +246,64 @@ pub(crate) unsafe fn parse_typed_value(item_type: SCM, data: SCM) -> Result<Type
     }
 }
 
+fn int_to_typed_value(type_name: &str, value: i64) -> Option<Result<TypedValue, SkyliteProcError>> {
+    fn conv<T: TryFrom<i64>>(value: i64) -> Result<T, SkyliteProcError>
+    where <T as TryFrom<i64>>::Error: Display
+    {
+        T::try_from(value).map_err(|err| SkyliteProcError::DataError(format!("{}", err)))
+    }
+
+    let out = match type_name {
+        "u8" => conv(value).map(TypedValue::U8),
+        "u16" => conv(value).map(TypedValue::U16),
+        "u32" => conv(value).map(TypedValue::U32),
+        "u64" => conv(value).map(TypedValue::U64),
+        "i8" => conv(value).map(TypedValue::I8),
+        "i16" => conv(value).map(TypedValue::I16),
+        "i32" => conv(value).map(TypedValue::I32),
+        "i64" => Ok(TypedValue::I64(value)),
+        _ => return None
+    };
+    Some(out)
+}
+
+/// Bulk conversion for `(vec <integer type>)`: the whole list is pulled
+/// into an i64 array in one FFI call instead of two crossings plus a
+/// type check per element. Returns `None` if the element type is not an
+/// integer primitive.
+unsafe fn parse_int_vec(type_name: &str, data: SCM) -> Option<Result<TypedValue, SkyliteProcError>> {
+    // Probe the conversion first to make sure the type is integral
+    // before committing to the bulk path.
+    if int_to_typed_value(type_name, 0).is_none() {
+        return None;
+    }
+
+    let len = scm_list_length(data);
+    if len < 0 {
+        return Some(Err(SkyliteProcError::DataError(format!("Not a list: {}", form_to_string(data)))));
+    }
+    let mut raw = vec![0_i64; len as usize];
+    if scm_list_to_int64_array(data, raw.as_mut_ptr(), len) < 0 {
+        return Some(Err(SkyliteProcError::DataError(format!("Expected list of integers: {}", form_to_string(data)))));
+    }
+
+    let out: Result<Vec<TypedValue>, SkyliteProcError> = raw.into_iter()
+        .map(|value| int_to_typed_value(type_name, value).unwrap())
+        .collect();
+    Some(out.map(TypedValue::Vec))
+}
+
 unsafe fn parse_typed_value_vec(vec_type: SCM, data: SCM) -> Result<TypedValue, SkyliteProcError> {
     let item_type = cxr(vec_type, &[CDR, CAR])?;
-    let mut out: Vec<TypedValue> = Vec::new();
 
+    if scm_is_symbol(item_type) {
+        let type_name = conv_symbol(item_type)?;
+        if let Some(res) = parse_int_vec(&type_name, data) {
+            return res;
+        }
+    }
+
+    let mut out: Vec<TypedValue> = Vec::new();
     for item in iter_list(data)? {
         out.push(parse_typed_value(item_type, item)?)
     }
@@ -214,7 +312,7 @@ unsafe fn parse_typed_value_vec(vec_type: SCM, data: SCM) -> Result<TypedValue,
 }
 
 unsafe fn parse_typed_value_tuple(types: SCM, values: SCM) -> Result<TypedValue, SkyliteProcError> {
-    if scm_to_int64(scm_length(types)) != scm_to_int64(scm_length(values)) {
+    if scm_list_length(types) != scm_list_length(values) {
         return Err(SkyliteProcError::DataError(format!("Tuple definition has differing number of types and values.")));
     }
 
@@ -226,6 +324,46 @@ unsafe fn parse_typed_value_tuple(types: SCM, values: SCM) -> Result<TypedValue,
     Ok(TypedValue::Tuple(out))
 }
 
+thread_local! {
+    // Whether the file reading helper has been defined for this
+    // thread's Guile module yet.
+    static READ_FILE_HELPER_DEFINED: Cell<bool> = Cell::new(false);
+}
+
+/// Reads the first datum from the given file using the Guile reader.
+///
+/// Asset files are pure data, so this skips the evaluator entirely:
+/// the file is opened as a port and handed to `read`, with the
+/// exception guard installed once per worker thread instead of being
+/// formatted into a wrapper string per expression. Note that the file
+/// must contain a plain datum, not a quoted expression.
+pub(crate) unsafe fn read_scheme_file(path: &Path) -> Result<SCM, SkyliteProcError> {
+    READ_FILE_HELPER_DEFINED.with(|defined| {
+        if !defined.get() {
+            let helper = CString::new("\
+                (define (skylite-read-file path)
+                  (with-exception-handler
+                    (lambda (exc) `(err . ,exc))
+                    (lambda () `(ok . ,(call-with-input-file path read)))
+                    #:unwind? #t))").unwrap();
+            scm_c_eval_string(helper.as_ptr());
+            defined.set(true);
+        }
+    });
+
+    let name = CString::new("skylite-read-file").unwrap();
+    let path_cstr = CString::new(path.to_string_lossy().as_bytes()).unwrap();
+    let res = scm_call_1(
+        scm_variable_ref(scm_c_lookup(name.as_ptr())),
+        scm_from_utf8_string(path_cstr.as_ptr())
+    );
+    if conv_symbol(scm_car(res))? == "err" {
+        Err(SkyliteProcError::GuileException(scm_cdr(res)))
+    } else {
+        Ok(scm_cdr(res))
+    }
+}
+
 pub(crate) unsafe fn eval_str(expr: &str) -> Result<SCM, SkyliteProcError> {
     let safe_expr = format!("\
         (with-exception-handler
@@ -301,6 +439,10 @@ mod tests {
                 ])
             );
 
+            let type_name = eval_str("'(vec u8)").unwrap();
+            let value = eval_str("'(1 2 300)").unwrap();
+            assert!(parse_typed_value(type_name, value).is_err());
+
             let type_name = eval_str("'(vec i16)").unwrap();
             let value = eval_str("'(0 5 10 15 20 25)").unwrap();
             assert_eq!(
@@ -316,4 +458,21 @@ mod tests {
     fn test_typed_value() {
         with_guile(test_typed_value_impl, ());
     }
+
+    extern "C" fn test_read_scheme_file_impl(_: &()) {
+        let path = std::env::temp_dir().join(format!("skylite-test-read-{}.scm", std::process::id()));
+        std::fs::write(&path, "((name . test) (value . 5))").unwrap();
+        unsafe {
+            let form = super::read_scheme_file(&path).unwrap();
+            assert_eq!(crate::parse_util::form_to_string(form), "((name . test) (value . 5))");
+
+            assert!(super::read_scheme_file(&path.with_extension("missing")).is_err());
+        }
+        std::fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn test_read_scheme_file() {
+        with_guile(test_read_scheme_file_impl, ());
+    }
 }
@@ -1,8 +1,11 @@
+use std::path::{Path, PathBuf};
+
 use crate::guile::{scm_is_false, scm_list_p, SCM};
+use crate::parse_cache::{self, CacheSerialize};
 use crate::parse_util::CXROp::{CAR, CDR};
-use crate::SkyliteProcError;
+use crate::{with_guile_pool, SkyliteProcError};
 use glob::Pattern;
-use crate::parse_util::{assq_str, conv_string, conv_symbol, cxr, iter_list, parse_typed_value, TypedValue};
+use crate::parse_util::{assq_str, conv_string, conv_symbol, cxr, eval_str, form_to_string, iter_list, parse_typed_value, read_scheme_file, TypedValue};
 
 #[derive(PartialEq, Debug)]
 struct AssetDirectories {
@@ -58,6 +61,81 @@ impl AssetDirectories {
     }
 }
 
+/// Parses a single asset definition file on a Guile worker thread and
+/// returns its canonical written form. The file is loaded through the
+/// Guile reader directly, without evaluation. SCM values must not leave
+/// their worker thread, so the result is reduced to strings before
+/// crossing back.
+extern "C" fn parse_asset_file(path: &PathBuf) -> Result<String, String> {
+    unsafe {
+        match read_scheme_file(path) {
+            Ok(form) => Ok(form_to_string(form)),
+            Err(SkyliteProcError::GuileException(exc)) =>
+                Err(format!("Exception while parsing {}: {}", path.display(), form_to_string(exc))),
+            Err(err) => Err(format!("Error while parsing {}: {:?}", path.display(), err))
+        }
+    }
+}
+
+impl AssetDirectories {
+    fn all_patterns(&self) -> impl Iterator<Item = &Pattern> {
+        self.actors.iter()
+            .chain(self.scenes.iter())
+            .chain(self.graphics.iter())
+            .chain(self.sprites.iter())
+            .chain(self.tilesets.iter())
+            .chain(self.maps.iter())
+    }
+
+    /// Expands the asset globs, relative to `base_dir`, into the list of
+    /// matching asset files.
+    fn collect_asset_files(&self, base_dir: &Path) -> Result<Vec<PathBuf>, SkyliteProcError> {
+        let mut out = Vec::new();
+        for pattern in self.all_patterns() {
+            let full_pattern = base_dir.join(pattern.as_str());
+            let matches = glob::glob(&full_pattern.to_string_lossy())
+                .map_err(|err| SkyliteProcError::DataError(format!("Not a valid glob: {}", err)))?;
+            for path in matches {
+                out.push(path.map_err(|err| SkyliteProcError::DataError(format!("{}", err)))?);
+            }
+        }
+        Ok(out)
+    }
+
+    /// Parses every asset file matched by the directory globs and
+    /// returns (path, canonical form) pairs in a stable order. Files
+    /// whose content is already in the persistent parse cache are
+    /// served from it; only the changed files are distributed across
+    /// the Guile worker pool. An unchanged asset set skips Guile
+    /// entirely.
+    fn parse_assets(&self, base_dir: &Path) -> Result<Vec<(PathBuf, String)>, SkyliteProcError> {
+        let files = self.collect_asset_files(base_dir)?;
+
+        let mut forms: Vec<Option<String>> = vec![None; files.len()];
+        let mut misses: Vec<(usize, String)> = Vec::new();
+        for (idx, path) in files.iter().enumerate() {
+            let source = std::fs::read_to_string(path)
+                .map_err(|err| SkyliteProcError::DataError(format!("Could not read {}: {}", path.display(), err)))?;
+            match parse_cache::load::<String>(&source) {
+                Some(form) => forms[idx] = Some(form),
+                None => misses.push((idx, source))
+            }
+        }
+
+        let miss_paths: Vec<PathBuf> = misses.iter().map(|(idx, _)| files[*idx].clone()).collect();
+        let parsed = with_guile_pool(parse_asset_file, miss_paths);
+        for ((idx, source), form) in Iterator::zip(misses.into_iter(), parsed) {
+            let form = form.map_err(SkyliteProcError::DataError)?;
+            parse_cache::store(&source, &form);
+            forms[idx] = Some(form);
+        }
+
+        Ok(Iterator::zip(files.into_iter(), forms)
+            .map(|(path, form)| (path, form.unwrap()))
+            .collect())
+    }
+}
+
 impl Default for AssetDirectories {
     fn default() -> Self {
         Self {
@@ -72,9 +150,45 @@ impl Default for AssetDirectories {
 }
 
 #[derive(PartialEq, Debug)]
-struct SaveItem {
-    name: String,
-    data: TypedValue
+pub(crate) struct SaveItem {
+    pub(crate) name: String,
+    pub(crate) data: TypedValue
+}
+
+impl CacheSerialize for SaveItem {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        self.name.serialize(out);
+        self.data.serialize(out);
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<SaveItem> {
+        Some(SaveItem {
+            name: String::deserialize(data)?,
+            data: TypedValue::deserialize(data)?
+        })
+    }
+}
+
+impl CacheSerialize for AssetDirectories {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        self.actors.serialize(out);
+        self.scenes.serialize(out);
+        self.graphics.serialize(out);
+        self.sprites.serialize(out);
+        self.tilesets.serialize(out);
+        self.maps.serialize(out);
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<AssetDirectories> {
+        Some(AssetDirectories {
+            actors: Vec::deserialize(data)?,
+            scenes: Vec::deserialize(data)?,
+            graphics: Vec::deserialize(data)?,
+            sprites: Vec::deserialize(data)?,
+            tilesets: Vec::deserialize(data)?,
+            maps: Vec::deserialize(data)?
+        })
+    }
 }
 
 impl SaveItem {
@@ -99,7 +213,51 @@ struct SkyliteProject {
     tile_types: Vec<String>
 }
 
+impl CacheSerialize for SkyliteProject {
+    fn serialize(&self, out: &mut Vec<u8>) {
+        self.name.serialize(out);
+        self.assets.serialize(out);
+        self.save_data.serialize(out);
+        self.tile_types.serialize(out);
+    }
+
+    fn deserialize(data: &mut &[u8]) -> Option<SkyliteProject> {
+        Some(SkyliteProject {
+            name: String::deserialize(data)?,
+            assets: AssetDirectories::deserialize(data)?,
+            save_data: Vec::deserialize(data)?,
+            tile_types: Vec::deserialize(data)?
+        })
+    }
+}
+
+/// Parses a project definition on a Guile thread. Errors are reduced to
+/// strings because SCM values must not leave the thread.
+extern "C" fn parse_project_source(source: &String) -> Result<SkyliteProject, String> {
+    unsafe {
+        match eval_str(source).and_then(|form| SkyliteProject::from_scheme(form)) {
+            Ok(project) => Ok(project),
+            Err(SkyliteProcError::GuileException(exc)) => Err(form_to_string(exc)),
+            Err(SkyliteProcError::DataError(err)) => Err(err)
+        }
+    }
+}
+
 impl SkyliteProject {
+    /// Parses a project definition from its source text, going through
+    /// the persistent parse cache: if SKYLITE_CACHE_DIR already holds
+    /// the result for this exact source, Guile is not involved at all.
+    fn from_source(source: &str) -> Result<SkyliteProject, SkyliteProcError> {
+        if let Some(cached) = parse_cache::load::<SkyliteProject>(source) {
+            return Ok(cached);
+        }
+
+        let project = crate::with_guile(parse_project_source, source.to_owned())
+            .map_err(SkyliteProcError::DataError)?;
+        parse_cache::store(source, &project);
+        Ok(project)
+    }
+
     fn from_scheme(definition: SCM) -> Result<SkyliteProject, SkyliteProcError> {
         unsafe {
             let name = conv_symbol(
@@ -144,10 +302,39 @@ impl SkyliteProject {
 mod tests {
     use glob::Pattern;
 
-    use crate::{parse_util::{eval_str, TypedValue}, project::{AssetDirectories, SaveItem}, with_guile};
+    use crate::{parse_cache::CacheSerialize, parse_util::{eval_str, TypedValue}, project::{AssetDirectories, SaveItem}, with_guile};
 
     use super::SkyliteProject;
 
+    #[test]
+    fn test_cache_serialization() {
+        let project = SkyliteProject {
+            name: "TestProject".to_owned(),
+            assets: AssetDirectories::default(),
+            save_data: vec![
+                SaveItem {
+                    name: "progress".to_owned(),
+                    data: TypedValue::Tuple(vec![
+                        TypedValue::U8(3),
+                        TypedValue::String("overworld".to_owned()),
+                        TypedValue::Vec(vec![TypedValue::I16(-5), TypedValue::I16(12)])
+                    ])
+                }
+            ],
+            tile_types: vec!["solid".to_owned(), "non-solid".to_owned()]
+        };
+
+        let mut bytes = Vec::new();
+        project.serialize(&mut bytes);
+        let mut data = &bytes[..];
+        assert_eq!(SkyliteProject::deserialize(&mut data).unwrap(), project);
+        assert!(data.is_empty());
+
+        // Truncated data is a miss, not a panic.
+        let mut truncated = &bytes[..bytes.len() / 2];
+        assert!(SkyliteProject::deserialize(&mut truncated).is_none());
+    }
+
     extern "C" fn test_project_parsing_impl(_: &()) {
         unsafe {
             let definition = eval_str(
@@ -188,4 +375,19 @@ mod tests {
     fn test_project_parsing() {
         with_guile(test_project_parsing_impl, ());
     }
+
+    #[test]
+    fn test_parse_assets() {
+        let dir = std::env::temp_dir().join(format!("skylite-test-assets-{}", std::process::id()));
+        std::fs::create_dir_all(dir.join("actors")).unwrap();
+        std::fs::write(dir.join("actors/actor1.scm"), "((name . actor1))").unwrap();
+        std::fs::write(dir.join("actors/actor2.scm"), "((name . actor2))").unwrap();
+
+        let parsed = AssetDirectories::default().parse_assets(&dir).unwrap();
+        assert_eq!(parsed.len(), 2);
+        assert!(parsed.iter().any(|(path, form)| path.ends_with("actor1.scm") && form == "((name . actor1))"));
+        assert!(parsed.iter().any(|(path, form)| path.ends_with("actor2.scm") && form == "((name . actor2))"));
+
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
 }
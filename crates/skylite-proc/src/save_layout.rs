@@ -0,0 +1,202 @@
+use proc_macro2::{Literal, TokenStream};
+use quote::{format_ident, quote};
+
+use crate::parse_util::TypedValue;
+use crate::project::SaveItem;
+
+/// Size in bytes of the fixed layout for the given value. Variable-size
+/// values (strings, vectors) are fixed to the shape of the default
+/// value, so the whole save-data block has one layout known at build
+/// time.
+pub(crate) fn value_size(value: &TypedValue) -> usize {
+    match value {
+        TypedValue::U8(_) | TypedValue::I8(_) | TypedValue::Bool(_) => 1,
+        TypedValue::U16(_) | TypedValue::I16(_) => 2,
+        TypedValue::U32(_) | TypedValue::I32(_) | TypedValue::F32(_) => 4,
+        TypedValue::U64(_) | TypedValue::I64(_) | TypedValue::F64(_) => 8,
+        TypedValue::String(s) => s.len(),
+        TypedValue::Tuple(items) | TypedValue::Vec(items) => items.iter().map(value_size).sum()
+    }
+}
+
+/// Appends the flat little-endian image of the given value.
+pub(crate) fn write_image(value: &TypedValue, out: &mut Vec<u8>) {
+    match value {
+        TypedValue::U8(v) => out.push(*v),
+        TypedValue::U16(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::U32(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::U64(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::I8(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::I16(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::I32(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::I64(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::F32(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::F64(v) => out.extend_from_slice(&v.to_le_bytes()),
+        TypedValue::Bool(v) => out.push(*v as u8),
+        TypedValue::String(s) => out.extend_from_slice(s.as_bytes()),
+        TypedValue::Tuple(items) | TypedValue::Vec(items) => {
+            for item in items {
+                write_image(item, out);
+            }
+        }
+    }
+}
+
+/// Item names come from Scheme symbols, which commonly contain dashes.
+fn accessor_name(name: &str) -> String {
+    name.replace('-', "_")
+}
+
+/// Generates the accessors for one save item at the given byte offset.
+/// Primitive items get typed getters and setters; aggregate items are
+/// exposed as their byte range, since their layout is already flat.
+fn item_accessors(item: &SaveItem, offset: usize, size: usize) -> TokenStream {
+    let getter = format_ident!("{}", accessor_name(&item.name));
+    let setter = format_ident!("set_{}", accessor_name(&item.name));
+
+    let primitive = match item.data {
+        TypedValue::U8(_) => Some(quote! { u8 }),
+        TypedValue::U16(_) => Some(quote! { u16 }),
+        TypedValue::U32(_) => Some(quote! { u32 }),
+        TypedValue::U64(_) => Some(quote! { u64 }),
+        TypedValue::I8(_) => Some(quote! { i8 }),
+        TypedValue::I16(_) => Some(quote! { i16 }),
+        TypedValue::I32(_) => Some(quote! { i32 }),
+        TypedValue::I64(_) => Some(quote! { i64 }),
+        TypedValue::F32(_) => Some(quote! { f32 }),
+        TypedValue::F64(_) => Some(quote! { f64 }),
+        _ => None
+    };
+
+    if let Some(item_type) = primitive {
+        return quote! {
+            pub fn #getter(&self) -> #item_type {
+                #item_type::from_le_bytes(self.data[#offset..#offset + #size].try_into().unwrap())
+            }
+
+            pub fn #setter(&mut self, value: #item_type) {
+                self.data[#offset..#offset + #size].copy_from_slice(&value.to_le_bytes());
+            }
+        };
+    }
+
+    match item.data {
+        TypedValue::Bool(_) => quote! {
+            pub fn #getter(&self) -> bool {
+                self.data[#offset] != 0
+            }
+
+            pub fn #setter(&mut self, value: bool) {
+                self.data[#offset] = value as u8;
+            }
+        },
+        _ => quote! {
+            pub fn #getter(&self) -> &[u8] {
+                &self.data[#offset..#offset + #size]
+            }
+
+            pub fn #setter(&mut self, value: &[u8]) {
+                self.data[#offset..#offset + #size].copy_from_slice(value);
+            }
+        }
+    }
+}
+
+/// Lowers the parsed save-data items into a flat, fixed-layout block:
+/// a `SaveData` struct over a `[u8; N]` with typed accessors at fixed
+/// offsets, whose default image is a `const` built at macro expansion
+/// time. Serializing into `SkyliteTarget::save_state` is then a plain
+/// copy of the backing bytes, and the default save data lives in ROM
+/// with no startup construction.
+pub(crate) fn generate_save_data(items: &[SaveItem]) -> TokenStream {
+    let size = items.iter().map(|item| value_size(&item.data)).sum::<usize>();
+    let mut image = Vec::with_capacity(size);
+    for item in items {
+        write_image(&item.data, &mut image);
+    }
+    let image_literal = Literal::byte_string(&image);
+
+    let mut accessors = TokenStream::new();
+    let mut offset = 0;
+    for item in items {
+        let item_size = value_size(&item.data);
+        accessors.extend(item_accessors(item, offset, item_size));
+        offset += item_size;
+    }
+
+    quote! {
+        /// Fixed-layout save data block generated from the project's
+        /// save-data definition.
+        pub struct SaveData {
+            data: [u8; #size]
+        }
+
+        impl SaveData {
+            /// The default save data, as defined in the project file.
+            pub const DEFAULT: SaveData = SaveData { data: *#image_literal };
+
+            /// The raw bytes, in the exact form expected by
+            /// `from_bytes` and suitable for `save_state`.
+            pub fn as_bytes(&self) -> &[u8] {
+                &self.data
+            }
+
+            pub fn from_bytes(data: &[u8]) -> SaveData {
+                let mut out = SaveData::DEFAULT;
+                out.data.copy_from_slice(data);
+                out
+            }
+
+            #accessors
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::parse_util::TypedValue;
+    use crate::project::SaveItem;
+
+    use super::{generate_save_data, value_size, write_image};
+
+    #[test]
+    fn test_image_layout() {
+        let value = TypedValue::Tuple(vec![
+            TypedValue::U16(0x1234),
+            TypedValue::Bool(true),
+            TypedValue::Vec(vec![TypedValue::I8(-1), TypedValue::I8(2)]),
+            TypedValue::String("ab".to_owned())
+        ]);
+        assert_eq!(value_size(&value), 7);
+
+        let mut image = Vec::new();
+        write_image(&value, &mut image);
+        assert_eq!(image, vec![0x34, 0x12, 1, 0xff, 2, b'a', b'b']);
+    }
+
+    #[test]
+    fn test_generated_accessors() {
+        let items = vec![
+            SaveItem {
+                name: "flag-one".to_owned(),
+                data: TypedValue::Bool(false)
+            },
+            SaveItem {
+                name: "score".to_owned(),
+                data: TypedValue::U32(100)
+            },
+            SaveItem {
+                name: "inventory".to_owned(),
+                data: TypedValue::Vec(vec![TypedValue::U8(0), TypedValue::U8(0)])
+            }
+        ];
+
+        let out = generate_save_data(&items).to_string();
+        assert!(out.contains("pub struct SaveData"), "unexpected output: {}", out);
+        assert!(out.contains("data : [u8 ; 7usize]"), "unexpected output: {}", out);
+        assert!(out.contains("pub fn flag_one (& self) -> bool"), "unexpected output: {}", out);
+        assert!(out.contains("pub fn set_score (& mut self , value : u32)"), "unexpected output: {}", out);
+        assert!(out.contains("pub fn inventory (& self) -> & [u8]"), "unexpected output: {}", out);
+        assert!(out.contains("pub const DEFAULT"), "unexpected output: {}", out);
+    }
+}